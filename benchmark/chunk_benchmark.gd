@@ -0,0 +1,193 @@
+# chunk_benchmark.gd
+extends SceneTree
+
+# Headless chunk generation benchmark, fixed seed, JSON report:
+#   godot --headless --script res://benchmark/chunk_benchmark.gd -- [--out=PATH] [--seed=N] [--threads=N]
+#
+# fills       Chunk (and ServerChunk, VoxelChunk) generation straight on the
+#             WorkerThreadPool: chunks/sec, per chunk latency and memory,
+#             16x16 at 1..N threads, 32x32 and 64x64 at N
+# sampling    height grids per second, CPU sampler against the compute
+#             shader one; the GPU only exists without --headless
+# startup     world.gd streaming its first full view at 1..N chunk jobs
+#
+# Compare reports between revisions on the same machine only.
+
+const world_script = preload("res://world-gen/world.gd")
+const chunk_size = world_script.chunk_size
+const skirt_depth = 16.0
+
+var noise_seed = 1234
+var out_path = "user://chunk_benchmark.json"
+var max_threads = OS.get_processor_count()
+
+func _initialize():
+	for arg in OS.get_cmdline_user_args():
+		if arg.begins_with("--out="):
+			out_path = arg.trim_prefix("--out=")
+		elif arg.begins_with("--seed="):
+			noise_seed = int(arg.trim_prefix("--seed="))
+		elif arg.begins_with("--threads="):
+			max_threads = max(1, int(arg.trim_prefix("--threads=")))
+	run()
+
+func thread_counts():
+	var counts = []
+	var threads = 1
+	while threads < max_threads:
+		counts.append(threads)
+		threads *= 2
+	counts.append(max_threads)
+	return counts
+
+func run():
+	var report = {
+		"engine": Engine.get_version_info().string,
+		"processors": OS.get_processor_count(),
+		"seed": noise_seed,
+		"time": Time.get_datetime_string_from_system(true),
+		"fills": [],
+		"sampling": {},
+		"startup": [],
+	}
+
+	for threads in thread_counts():
+		report.fills.append(bench_fill(Chunk, 16, threads))
+	report.fills.append(bench_fill(ServerChunk, 16, max_threads))
+	report.fills.append(bench_fill(VoxelChunk, 16, max_threads))
+	report.fills.append(bench_fill(Chunk, 32, max_threads))
+	report.fills.append(bench_fill(Chunk, 64, max_threads))
+	report.sampling = bench_sampling(256)
+	for threads in thread_counts():
+		report.startup.append(await bench_startup(threads))
+
+	var text = JSON.stringify(report, "\t")
+	print(text)
+	var file = FileAccess.open(out_path, FileAccess.WRITE)
+	if file == null:
+		push_error("Cannot write %s" % out_path)
+		quit(1)
+		return
+	file.store_string(text)
+	file.close()
+	quit()
+
+func make_cache():
+	var noise = world_script.make_noise(noise_seed)
+	return HeightmapCache.new(noise, chunk_size, Chunk.grid_resolution(chunk_size), Chunk.height_scale)
+
+func fill_cells(size):
+	var cells = []
+	for z in range(size):
+		for x in range(size):
+			cells.append(Vector2i(x - size / 2, z - size / 2))
+	return cells
+
+func bench_fill(chunk_class, size, threads):
+	var cache = make_cache()
+	var profiler = ChunkProfiler.new()
+	var cells = fill_cells(size)
+	var field = VoxelField.new(noise_seed)
+	var chunks = []
+	chunks.resize(cells.size())
+	# Static memory in use as each chunk finished, one slot per job so threads never share one
+	var usage = []
+	usage.resize(cells.size())
+
+	var memory_before = OS.get_static_memory_usage()
+	var start = Time.get_ticks_usec()
+	var build = func(index):
+		var chunk_start = Time.get_ticks_usec()
+		var cell = cells[index]
+		var chunk = chunk_class.new(cache.noise, cell.x * chunk_size, cell.y * chunk_size, chunk_size, cache)
+		if chunk is VoxelChunk:
+			chunk.field = field
+		chunk.generate_chunk(0, skirt_depth)
+		chunks[index] = chunk
+		usage[index] = OS.get_static_memory_usage()
+		profiler.since("chunk", chunk_start)
+	var task = WorkerThreadPool.add_group_task(build, cells.size(), threads, true, "chunk benchmark")
+	WorkerThreadPool.wait_for_group_task_completion(task)
+	var seconds = (Time.get_ticks_usec() - start) / 1000000.0
+	var memory_after = OS.get_static_memory_usage()
+
+	var resident = 0
+	for chunk in chunks:
+		resident += chunk.get_memory_bytes()
+		if chunk is Node:
+			chunk.free()
+		else:
+			chunk.release()
+
+	return {
+		"kind": {Chunk: "Chunk", ServerChunk: "ServerChunk", VoxelChunk: "VoxelChunk"}[chunk_class],
+		"fill": "%dx%d" % [size, size],
+		"threads": threads,
+		"chunks": cells.size(),
+		"seconds": seconds,
+		"chunks_per_sec": cells.size() / seconds,
+		"latency_ms": profiler.summary("chunk"),
+		"static_memory_mb": (memory_after - memory_before) / 1048576.0,
+		# Above the start of this fill; the process wide peak would repeat the largest earlier fill
+		"peak_static_memory_mb": (max(memory_after, usage.max()) - memory_before) / 1048576.0,
+		"resident_mb": resident / 1048576.0,
+	}
+
+func bench_sampling(count):
+	var cache = make_cache()
+	var cells = fill_cells(int(sqrt(count)))
+	var cpu_grids = {}
+	var start = Time.get_ticks_usec()
+	for cell in cells:
+		cpu_grids[cell] = cache.build_grid(cell)
+	var result = {
+		"grids": cells.size(),
+		"cpu_grids_per_sec": cells.size() / ((Time.get_ticks_usec() - start) / 1000000.0),
+		"gpu_available": false,
+	}
+
+	var gpu = GpuHeightmapSampler.new(cache, 32)
+	if not gpu.is_available():
+		return result
+
+	var gpu_grids = {}
+	start = Time.get_ticks_usec()
+	for first in range(0, cells.size(), gpu.batch_size):
+		gpu.submit(cells.slice(first, first + gpu.batch_size))
+		gpu_grids.merge(gpu.collect())
+	result.gpu_grids_per_sec = cells.size() / ((Time.get_ticks_usec() - start) / 1000000.0)
+
+	var difference = 0.0
+	for cell in gpu_grids:
+		var grid = gpu_grids[cell]
+		var expected = cpu_grids[cell]
+		for i in range(grid.size()):
+			difference = max(difference, abs(grid[i] - expected[i]))
+	result.gpu_available = true
+	# Float rounding only, anything larger means the shader port drifted
+	result.gpu_max_difference = difference
+	gpu.release()
+	return result
+
+# world.gd over the real main loop until its first view is complete
+func bench_startup(threads):
+	var world = world_script.new()
+	world.randomize_seed = false
+	world.world_seed = noise_seed
+	world.max_chunk_jobs = threads
+	var player = Node3D.new()
+	player.name = "CameraController"
+	world.add_child(player)
+	root.add_child(world)
+
+	var msec = await world.startup_finished
+	var result = {
+		"threads": threads,
+		"startup_msec": msec,
+		"chunks": world.get_resident_chunk_count(),
+		"resident_mb": world.get_resident_bytes() / 1048576.0,
+		"max_integration_msec": world.get_integration_stats().max_msec,
+	}
+	world.queue_free()
+	await process_frame
+	return result
@@ -0,0 +1,222 @@
+# chunk_service_check.gd
+extends SceneTree
+
+# Headless loopback check of ChunkService and ChunkServiceClient, exits
+# non zero on the first failure:
+#   godot --headless --script res://benchmark/chunk_service_check.gd -- [--port=N] [--seed=N]
+# Needs loopback UDP on port and port + 1 (the world check expects nothing
+# there). Run it after any change under world-gen/net.
+#
+# handshake   a client with the server's params hash gets ready, one with
+#             another hash fails
+# grids       requested grids arrive bit-identical to local sampling,
+#             cancelled ones never do
+# malformed   a request with a bogus count is dropped, the service keeps going
+# limits      a client asking for more cells than the service allows is dropped
+# world       world.gd starts up through the service, and without one
+#             (nothing listening) falls back to local generation
+
+const world_script = preload("res://world-gen/world.gd")
+const chunk_size = world_script.chunk_size
+const timeout_msec = 10000
+
+var noise_seed = 1234
+var port = 24560
+var service
+var failures = 0
+
+func _initialize():
+	for arg in OS.get_cmdline_user_args():
+		if arg.begins_with("--port="):
+			port = int(arg.trim_prefix("--port="))
+		elif arg.begins_with("--seed="):
+			noise_seed = int(arg.trim_prefix("--seed="))
+	run()
+
+func run():
+	var cache = make_cache()
+	service = ChunkService.new(make_cache(), params_hash(cache.noise), port)
+	if not service.is_listening():
+		push_error("Cannot listen on port %d" % port)
+		quit(1)
+		return
+
+	await check_handshake(cache)
+	await check_grids(cache)
+	await check_malformed(cache)
+	await check_limits(cache)
+	await check_world()
+
+	service.close()
+	print("chunk service check: %s" % ("ok" if failures == 0 else "%d failures" % failures))
+	quit(0 if failures == 0 else 1)
+
+func make_cache():
+	var noise = world_script.make_noise(noise_seed)
+	return HeightmapCache.new(noise, chunk_size, Chunk.grid_resolution(chunk_size), Chunk.height_scale)
+
+func params_hash(noise):
+	return ChunkDiskCache.params_hash(noise, chunk_size, Chunk.grid_resolution(chunk_size), Chunk.height_scale)
+
+func expect(condition, what):
+	print("%s  %s" % ["ok  " if condition else "FAIL", what])
+	if not condition:
+		failures += 1
+
+func connect_client(cache, hash_text = null):
+	var client = ChunkServiceClient.new("127.0.0.1", port, params_hash(cache.noise) if hash_text == null else hash_text, cache.grid_width())
+	var start = Time.get_ticks_msec()
+	while not client.is_ready() and not client.is_failed() and Time.get_ticks_msec() - start < timeout_msec:
+		await poll_frame([client])
+	return client
+
+# One frame of both ends, the client first so its packets go out before the service reads
+func poll_frame(clients):
+	for client in clients:
+		client.poll()
+	service.poll()
+	await process_frame
+
+func has_remote_source(world):
+	for source in world.grid_sources:
+		if source is RemoteGridSource:
+			return true
+	return false
+
+func wait_until(condition, clients):
+	var start = Time.get_ticks_msec()
+	while not condition.call() and Time.get_ticks_msec() - start < timeout_msec:
+		await poll_frame(clients)
+	return condition.call()
+
+func check_handshake(cache):
+	var client = await connect_client(cache)
+	expect(client.is_ready(), "client with the same params hash gets ready")
+	client.close()
+
+	var stranger = await connect_client(cache, "not the same terrain")
+	expect(stranger.is_failed(), "client with another params hash fails")
+
+func check_grids(cache):
+	var client = await connect_client(cache)
+	if not client.is_ready():
+		expect(false, "client connects for the grid check")
+		return
+
+	var cells = []
+	for z in range(-4, 4):
+		for x in range(-4, 4):
+			cells.append(Vector2i(x, z))
+	var kept = cells.slice(0, cells.size() / 2)
+	var cancelled = cells.slice(cells.size() / 2)
+
+	# Nothing is sampled until both the requests and the cancels are in
+	var max_jobs = service.max_jobs
+	service.max_jobs = 0
+	for i in range(cells.size()):
+		client.request(cells[i], float(i))
+	var waiting = func():
+		var count = 0
+		for peer in service.clients:
+			count += service.clients[peer].waiting.size()
+		return count
+	var all_waiting = func(): return waiting.call() == cells.size()
+	expect(await wait_until(all_waiting, [client]), "service receives %d requests" % cells.size())
+	for cell in cancelled:
+		client.cancel(cell)
+	var kept_waiting = func(): return waiting.call() == kept.size()
+	expect(await wait_until(kept_waiting, [client]), "service drops %d cancelled requests" % cancelled.size())
+	service.max_jobs = max_jobs
+
+	var received = {}
+	var all_kept = func():
+		received.merge(client.take_grids())
+		return received.size() >= kept.size()
+	await wait_until(all_kept, [client])
+	# A little longer, in case a cancelled grid still trickles in
+	for n in range(30):
+		await poll_frame([client])
+	received.merge(client.take_grids())
+
+	var identical = true
+	for cell in kept:
+		if not received.has(cell) or received[cell] != cache.build_grid(cell):
+			identical = false
+	expect(identical, "%d grids arrive identical to local sampling" % kept.size())
+	var leaked = 0
+	for cell in cancelled:
+		if received.has(cell):
+			leaked += 1
+	expect(leaked == 0, "no cancelled grid arrives")
+	client.close()
+
+func check_malformed(cache):
+	var client = await connect_client(cache)
+	if not client.is_ready():
+		expect(false, "client connects for the malformed packet check")
+		return
+
+	var buffer = StreamPeerBuffer.new()
+	buffer.put_u8(ChunkService.REQUEST)
+	buffer.put_u32(0xffffffff)
+	buffer.put_32(0)
+	client.server.send(ChunkService.control_channel, buffer.data_array, ENetPacketPeer.FLAG_RELIABLE)
+	for n in range(10):
+		await poll_frame([client])
+	client.request(Vector2i(40, 40), 0.0)
+	var grids = {}
+	var served = func():
+		grids.merge(client.take_grids())
+		return grids.has(Vector2i(40, 40))
+	await wait_until(served, [client])
+	expect(grids.has(Vector2i(40, 40)) and not client.is_failed(), "malformed request is dropped, later requests still served")
+	client.close()
+
+func check_limits(cache):
+	var client = await connect_client(cache)
+	if not client.is_ready():
+		expect(false, "client connects for the limit check")
+		return
+
+	for n in range(service.max_packet_entries + 1):
+		client.request(Vector2i(n, 1000), 0.0)
+	var dropped = func(): return client.is_failed()
+	expect(await wait_until(dropped, [client]), "client over the per packet limit is disconnected")
+	client.close()
+
+func check_world():
+	var sent = service.grids_sent
+	var world = await start_world(port)
+	expect(world.get_startup_msec() >= 0, "world starts up through the service")
+	expect(service.grids_sent > sent, "world's grids come from the service")
+	await stop_world(world)
+
+	# Nothing listens there, so the client gives up and everything is local
+	world = await start_world(port + 1)
+	expect(world.get_startup_msec() >= 0, "world starts up without a service")
+	var start = Time.get_ticks_msec()
+	while has_remote_source(world) and Time.get_ticks_msec() - start < timeout_msec:
+		await process_frame
+	expect(not has_remote_source(world), "world drops an unreachable service")
+	await stop_world(world)
+
+func start_world(server_port):
+	var world = world_script.new()
+	world.randomize_seed = false
+	world.world_seed = noise_seed
+	world.chunk_server_address = "127.0.0.1"
+	world.chunk_server_port = server_port
+	var player = Node3D.new()
+	player.name = "CameraController"
+	world.add_child(player)
+	root.add_child(world)
+
+	var start = Time.get_ticks_msec()
+	while world.get_startup_msec() < 0 and Time.get_ticks_msec() - start < timeout_msec * 3:
+		service.poll()
+		await process_frame
+	return world
+
+func stop_world(world):
+	world.queue_free()
+	await process_frame
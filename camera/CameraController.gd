@@ -1,10 +1,20 @@
 extends CharacterBody3D
 
-@onready var camera = $rotationHelper/PhantomCamera3D
+# Free flying camera rig. Keys add up to one velocity, applied with a
+# single position write per physics tick and scaled by delta, so speed
+# and streaming load no longer depend on the tick rate. Mouse look comes
+# from relative motion in _unhandled_input and is applied once per tick
+# too. velocity (CharacterBody3D's own) and get_heading() are what
+# world.gd's prefetch and frustum scheduling read.
+
 @onready var rotation_helper = $rotationHelper
+# Rotated for mouse look when present, otherwise rotationHelper is
+@onready var camera = get_node_or_null("rotationHelper/PhantomCamera3D")
 
-var SPEED = 100
-var MOUSE_SENSITIVITY = 10
+# Units per second, the old 100 units per tick at 60 ticks
+var SPEED = 6000
+# Degrees of turn per pixel of mouse motion
+var MOUSE_SENSITIVITY = 0.2
 
 const FORWARD = Vector3(0, 1, 0)
 const BACK = Vector3(0, -1, 0)
@@ -13,28 +23,52 @@ const RIGHT = Vector3(1, 0, 0)
 const UPWARD = Vector3(0,0,1)
 const DOWNWARD = Vector3(0,0,-1)
 
+# Mouse motion since the last tick, in pixels
+var look_motion = Vector2.ZERO
+
 func _ready():
 	await get_tree().physics_frame
 
+func _unhandled_input(event):
+	if event is InputEventMouseMotion:
+		look_motion += event.relative
 
 func _physics_process(delta):
 	# Movement
+	var direction = Vector3.ZERO
 	if Input.is_action_pressed("move_forward"):
-		translate(FORWARD * SPEED)
+		direction += FORWARD
 	if Input.is_action_pressed("move_backward"):
-		translate(BACK * SPEED)
+		direction += BACK
 	if Input.is_action_pressed("move_left"):
-		translate(LEFT * SPEED)
+		direction += LEFT
 	if Input.is_action_pressed("move_right"):
-		translate(RIGHT * SPEED)
+		direction += RIGHT
 	if Input.is_action_pressed("move_up"):
-		translate(UPWARD * SPEED)
+		direction += UPWARD
 	if Input.is_action_pressed("move_down"):
-		translate(DOWNWARD * SPEED)
+		direction += DOWNWARD
+
+	# Same local axes translate() used, diagonals no faster than straight lines
+	velocity = transform.basis * direction.normalized() * SPEED
+	if velocity != Vector3.ZERO:
+		position += velocity * delta
 
 	# Rotation
-	var camera_rotation = camera.rotation
-	camera_rotation.x += (get_viewport().get_mouse_position().x - camera_rotation.x) / MOUSE_SENSITIVITY
-	camera_rotation.y += (get_viewport().get_mouse_position().y - camera_rotation.y) / MOUSE_SENSITIVITY
-	camera.set_rotation(camera_rotation)
+	if look_motion != Vector2.ZERO:
+		var pivot = get_look_pivot()
+		var look_rotation = pivot.rotation
+		look_rotation.y -= deg_to_rad(look_motion.x * MOUSE_SENSITIVITY)
+		look_rotation.x = clamp(look_rotation.x - deg_to_rad(look_motion.y * MOUSE_SENSITIVITY), -PI * 0.49, PI * 0.49)
+		pivot.rotation = look_rotation
+		look_motion = Vector2.ZERO
+
+func get_look_pivot():
+	return camera if camera != null else rotation_helper
 
+# Flat forward direction of the view, zero when looking straight up or down.
+# Read from the rendering camera, the frustum world.gd culls against.
+func get_heading():
+	var view = get_viewport().get_camera_3d()
+	var forward = -(view if view != null else get_look_pivot()).global_transform.basis.z
+	return Vector2(forward.x, forward.z).normalized()
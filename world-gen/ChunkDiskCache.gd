@@ -0,0 +1,178 @@
+# ChunkDiskCache.gd
+extends RefCounted
+class_name ChunkDiskCache
+
+# Persistent store for sampled chunk height grids, so revisiting an area
+# or restarting with the same seed skips the noise. Grids live in region
+# files of region_size x region_size chunks under a directory named after
+# a hash of the seed, noise settings and grid layout; changing any of
+# them starts a fresh directory instead of returning stale terrain.
+#
+# Region file, little endian:
+#   u32 magic "UBCR", u32 format version, u32 region_size
+#   region_size^2 slots of u32 offset, u32 length (0 = empty)
+#   entries appended at the end: u32 raw length, 16 byte MD5 of the raw
+#   float32 grid, zstd compressed grid
+#
+# Called from pool threads. Each region has its own lock, so jobs in
+# different regions do not wait on each other.
+
+const magic = 0x52434255
+const version = 1
+const region_size = 32
+const header_bytes = 12
+const slot_bytes = 8
+const entry_header_bytes = 20
+
+var directory
+var grid_floats
+var tables = {}
+var region_locks = {}
+var mutex = Mutex.new()
+
+func _init(noise, chunk_size, resolution, height_scale, root = "user://chunk_cache"):
+	directory = root.path_join(params_hash(noise, chunk_size, resolution, height_scale))
+	DirAccess.make_dir_recursive_absolute(directory)
+	grid_floats = (resolution + 2) * (resolution + 2)
+
+# Same for the same terrain only, ChunkService clients check it as well
+static func params_hash(noise, chunk_size, resolution, height_scale):
+	var params
+	if noise is NoiseGraph:
+		params = [version, noise.get_cache_params(), chunk_size, resolution, height_scale]
+	else:
+		params = [version, noise.seed, noise.noise_type, noise.frequency, noise.offset,
+			noise.fractal_type, noise.fractal_octaves, noise.fractal_lacunarity, noise.fractal_gain,
+			noise.fractal_weighted_strength, chunk_size, resolution, height_scale]
+	return var_to_str(params).md5_text()
+
+func region_of(cell):
+	return Vector2i(floori(cell.x / float(region_size)), floori(cell.y / float(region_size)))
+
+func region_path(region):
+	return directory.path_join("r.%d.%d.bin" % [region.x, region.y])
+
+func slot_of(region, cell):
+	var local = cell - region * region_size
+	return local.y * region_size + local.x
+
+func region_lock(region):
+	mutex.lock()
+	var lock = region_locks.get(region)
+	if lock == null:
+		lock = Mutex.new()
+		region_locks[region] = lock
+	mutex.unlock()
+	return lock
+
+static func checksum(bytes):
+	var context = HashingContext.new()
+	context.start(HashingContext.HASH_MD5)
+	context.update(bytes)
+	return context.finish()
+
+# Returns null when the cell was never stored or its entry does not check out
+func load_grid(cell):
+	var region = region_of(cell)
+	var lock = region_lock(region)
+	lock.lock()
+	var grid = read_entry(region, cell)
+	lock.unlock()
+	return grid
+
+func store_grid(cell, grid):
+	var raw = grid.to_byte_array()
+	var packed = raw.compress(FileAccess.COMPRESSION_ZSTD)
+	var region = region_of(cell)
+	var lock = region_lock(region)
+	lock.lock()
+	write_entry(region, cell, raw, packed)
+	lock.unlock()
+
+# Slot table of a region, read from disk on first use. Caller holds the region lock.
+func get_table(region):
+	mutex.lock()
+	var table = tables.get(region)
+	mutex.unlock()
+	if table != null:
+		return table
+
+	var file = FileAccess.open(region_path(region), FileAccess.READ)
+	if file == null:
+		return null
+	if file.get_32() != magic or file.get_32() != version or file.get_32() != region_size:
+		return null
+	table = file.get_buffer(region_size * region_size * slot_bytes).to_int32_array()
+	if table.size() != region_size * region_size * 2:
+		return null
+
+	mutex.lock()
+	tables[region] = table
+	mutex.unlock()
+	return table
+
+func read_entry(region, cell):
+	var table = get_table(region)
+	if table == null:
+		return null
+	var slot = slot_of(region, cell)
+	var length = table[slot * 2 + 1]
+	if length <= entry_header_bytes:
+		return null
+
+	var file = FileAccess.open(region_path(region), FileAccess.READ)
+	if file == null:
+		return null
+	file.seek(table[slot * 2])
+	var raw_length = file.get_32()
+	var expected = file.get_buffer(16)
+	var raw = file.get_buffer(length - entry_header_bytes).decompress(raw_length, FileAccess.COMPRESSION_ZSTD)
+	if raw.size() != raw_length or checksum(raw) != expected:
+		return null
+
+	var grid = raw.to_float32_array()
+	if grid.size() != grid_floats:
+		return null
+	return grid
+
+func write_entry(region, cell, raw, packed):
+	var path = region_path(region)
+	var table = get_table(region)
+	if table == null:
+		# Missing or from another format version, start the region over
+		var created = FileAccess.open(path, FileAccess.WRITE)
+		if created == null:
+			return
+		table = PackedInt32Array()
+		table.resize(region_size * region_size * 2)
+		table.fill(0)
+		created.store_32(magic)
+		created.store_32(version)
+		created.store_32(region_size)
+		created.store_buffer(table.to_byte_array())
+		created.close()
+		mutex.lock()
+		tables[region] = table
+		mutex.unlock()
+
+	var file = FileAccess.open(path, FileAccess.READ_WRITE)
+	if file == null:
+		return
+	file.seek_end()
+	var offset = file.get_position()
+	file.store_32(raw.size())
+	file.store_buffer(checksum(raw))
+	file.store_buffer(packed)
+
+	var slot = slot_of(region, cell)
+	var length = entry_header_bytes + packed.size()
+	table[slot * 2] = offset
+	table[slot * 2 + 1] = length
+	# Packed arrays are values, the cached table has to be replaced
+	mutex.lock()
+	tables[region] = table
+	mutex.unlock()
+	file.seek(header_bytes + slot * slot_bytes)
+	file.store_32(offset)
+	file.store_32(length)
+	file.close()
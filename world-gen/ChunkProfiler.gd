@@ -0,0 +1,115 @@
+# ChunkProfiler.gd
+extends RefCounted
+class_name ChunkProfiler
+
+# Timings per chunk pipeline stage, fed from pool threads and the main
+# thread alike. Each stage keeps its last window_size samples for the
+# percentiles plus running totals over the whole session. Stages in use:
+#   queue      request pushed until a job or GPU batch picks it up
+#   gpu_batch  compute dispatch until its grids are read back
+#   disk_load  height grid read from the ChunkDiskCache
+#   sample     noise sampling for one height grid
+#   mesh       mesh arrays, normals included (same pass)
+#   upload     ArrayMesh surface creation or in place region update
+#   collision  HeightMapShape3D build
+#   job        whole pool job for one chunk
+#   integrate  one finished job activated on the main thread
+
+const stage_names = ["queue", "gpu_batch", "disk_load", "sample", "mesh", "upload", "collision", "job", "integrate"]
+const window_size = 2048
+const percentiles = [50, 95, 99]
+
+var stages = {}
+var mutex = Mutex.new()
+
+func record(stage, usec):
+	var msec = usec / 1000.0
+	mutex.lock()
+	var entry = stages.get(stage)
+	if entry == null:
+		entry = {"samples": PackedFloat32Array(), "next": 0, "count": 0, "total": 0.0, "max": 0.0}
+		entry.samples.resize(window_size)
+		stages[stage] = entry
+	entry.samples[entry.next] = msec
+	entry.next = (entry.next + 1) % window_size
+	entry.count += 1
+	entry.total += msec
+	entry.max = max(entry.max, msec)
+	mutex.unlock()
+
+# Records the time since start_usec, a Time.get_ticks_usec() reading
+func since(stage, start_usec):
+	record(stage, Time.get_ticks_usec() - start_usec)
+
+func clear():
+	mutex.lock()
+	stages.clear()
+	mutex.unlock()
+
+# count, mean, max and p50/p95/p99 in msec for one stage, empty when it never ran
+func summary(stage):
+	mutex.lock()
+	var entry = stages.get(stage)
+	if entry == null:
+		mutex.unlock()
+		return {}
+	var window = entry.samples.slice(0, min(entry.count, window_size))
+	var result = {"count": entry.count, "mean": entry.total / entry.count, "max": entry.max}
+	mutex.unlock()
+
+	window.sort()
+	for p in percentiles:
+		result["p%d" % p] = window[min(window.size() - 1, int(window.size() * p / 100.0))]
+	return result
+
+func get_stage_names():
+	mutex.lock()
+	var names = stages.keys()
+	mutex.unlock()
+	names.sort()
+	return names
+
+func to_dict():
+	var result = {}
+	for stage in get_stage_names():
+		result[stage] = summary(stage)
+	return result
+
+# Adds p50/p95/p99 of every stage to the debugger's Monitors tab
+func add_monitors():
+	for stage in stage_names:
+		for p in percentiles:
+			var id = monitor_id(stage, p)
+			if not Performance.has_custom_monitor(id):
+				Performance.add_custom_monitor(id, func(): return summary(stage).get("p%d" % p, 0.0))
+
+func remove_monitors():
+	for stage in stage_names:
+		for p in percentiles:
+			var id = monitor_id(stage, p)
+			if Performance.has_custom_monitor(id):
+				Performance.remove_custom_monitor(id)
+
+static func monitor_id(stage, p):
+	return "Chunks/%s p%d (ms)" % [stage, p]
+
+func format_text():
+	var lines = ["stage          count    mean     p50     p95     p99     max"]
+	for stage in get_stage_names():
+		var s = summary(stage)
+		lines.append("%-12s %7d %7.2f %7.2f %7.2f %7.2f %7.2f" % [stage, s.count, s.mean, s.p50, s.p95, s.p99, s.max])
+	return "\n".join(lines)
+
+# Writes every stage as CSV or, for a .json path, JSON. Returns an Error.
+func save(path):
+	var file = FileAccess.open(path, FileAccess.WRITE)
+	if file == null:
+		return FileAccess.get_open_error()
+	if path.get_extension() == "json":
+		file.store_string(JSON.stringify(to_dict(), "\t"))
+	else:
+		file.store_line("stage,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms")
+		for stage in get_stage_names():
+			var s = summary(stage)
+			file.store_line("%s,%d,%f,%f,%f,%f,%f" % [stage, s.count, s.mean, s.p50, s.p95, s.p99, s.max])
+	return OK
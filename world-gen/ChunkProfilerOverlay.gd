@@ -0,0 +1,33 @@
+# ChunkProfilerOverlay.gd
+extends CanvasLayer
+class_name ChunkProfilerOverlay
+
+# In game readout of a ChunkProfiler and the world's streaming stats,
+# refreshed a few times a second rather than every frame
+
+@export var refresh_seconds = 0.5
+
+var profiler
+var world
+var label
+var elapsed = 0.0
+
+func _ready():
+	label = Label.new()
+	label.position = Vector2(8, 8)
+	label.add_theme_font_size_override("font_size", 12)
+	add_child(label)
+
+func _process(delta):
+	elapsed += delta
+	if elapsed < refresh_seconds:
+		return
+	elapsed = 0.0
+
+	var text = profiler.format_text()
+	if world != null:
+		var stats = world.get_streaming_stats()
+		text += "\n\nresident %d chunks, %.1f MB, queue %d, %.1f chunks/s, holes %d" % [
+			world.get_resident_chunk_count(), world.get_resident_bytes() / 1048576.0,
+			stats.queue_depth, stats.throughput, stats.holes]
+	label.text = text
@@ -0,0 +1,104 @@
+# ChunkRequestQueue.gd
+extends RefCounted
+class_name ChunkRequestQueue
+
+# Min-heap of chunk cells keyed on a float priority, lower pops first.
+# Re-pushing or cancelling a cell only touches the lookup, stale heap
+# entries are skipped on pop and dropped when the heap gets too sparse.
+
+var heap_priority = []
+var heap_cell = []
+var queued = {}
+
+func size():
+	return queued.size()
+
+func is_empty():
+	return queued.is_empty()
+
+func has(cell):
+	return queued.has(cell)
+
+func cells():
+	return queued.keys()
+
+func push(cell, priority):
+	if queued.has(cell) and queued[cell] == priority:
+		return
+
+	queued[cell] = priority
+	heap_priority.append(priority)
+	heap_cell.append(cell)
+	sift_up(heap_cell.size() - 1)
+
+	if heap_cell.size() > queued.size() * 4 + 64:
+		rebuild()
+
+func cancel(cell):
+	return queued.erase(cell)
+
+func clear():
+	heap_priority.clear()
+	heap_cell.clear()
+	queued.clear()
+
+# Returns null when nothing is left
+func pop():
+	while not heap_cell.is_empty():
+		var cell = heap_cell[0]
+		var priority = heap_priority[0]
+		remove_top()
+		if queued.has(cell) and queued[cell] == priority:
+			queued.erase(cell)
+			return cell
+
+	return null
+
+func rebuild():
+	heap_priority.clear()
+	heap_cell.clear()
+	for cell in queued:
+		heap_priority.append(queued[cell])
+		heap_cell.append(cell)
+
+	for i in range(heap_cell.size() / 2 - 1, -1, -1):
+		sift_down(i)
+
+func remove_top():
+	var last = heap_cell.size() - 1
+	swap(0, last)
+	heap_priority.resize(last)
+	heap_cell.resize(last)
+	if last > 0:
+		sift_down(0)
+
+func sift_up(i):
+	while i > 0:
+		var parent = (i - 1) / 2
+		if heap_priority[parent] <= heap_priority[i]:
+			return
+		swap(i, parent)
+		i = parent
+
+func sift_down(i):
+	var count = heap_cell.size()
+	while true:
+		var smallest = i
+		var left = i * 2 + 1
+		var right = left + 1
+		if left < count and heap_priority[left] < heap_priority[smallest]:
+			smallest = left
+		if right < count and heap_priority[right] < heap_priority[smallest]:
+			smallest = right
+		if smallest == i:
+			return
+		swap(i, smallest)
+		i = smallest
+
+func swap(a, b):
+	var priority = heap_priority[a]
+	heap_priority[a] = heap_priority[b]
+	heap_priority[b] = priority
+	var cell = heap_cell[a]
+	heap_cell[a] = heap_cell[b]
+	heap_cell[b] = cell
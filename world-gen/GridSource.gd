@@ -0,0 +1,54 @@
+# GridSource.gd
+extends RefCounted
+class_name GridSource
+
+# Somewhere height grids come from other than sampling them in the chunk
+# job (GpuGridSource, RemoteGridSource). world.gd feeds every ready source
+# cells from the front of its request queue, puts the grids it hands back
+# into the HeightmapCache and queues their chunks; cells a source gives
+# up on come back to be sampled locally. Main thread only.
+
+# Cells handed to the source and not returned yet
+var in_flight = {}
+
+func has(cell):
+	return in_flight.has(cell)
+
+func size():
+	return in_flight.size()
+
+func cells():
+	return in_flight.keys()
+
+# Takes new cells this frame
+func is_ready():
+	return true
+
+# Gone for good, world.gd drops it after one last collect()
+func is_failed():
+	return false
+
+# Cells submit() takes before the next flush()
+func capacity():
+	return 0
+
+func submit(cell, priority):
+	in_flight[cell] = 1
+
+# After this frame's submits
+func flush():
+	pass
+
+func reprioritise(cell, priority):
+	pass
+
+# A grid for the cell that still arrives is dropped
+func cancel(cell):
+	in_flight.erase(cell)
+
+# {"grids": cell -> grid finished since the last call, "returned": cells to sample locally}
+func collect():
+	return {"grids": {}, "returned": []}
+
+func close():
+	pass
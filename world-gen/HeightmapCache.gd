@@ -0,0 +1,159 @@
+# HeightmapCache.gd
+extends RefCounted
+class_name HeightmapCache
+
+# Sampled height grids per chunk cell, each with a one sample apron so
+# normals along chunk borders see both sides. Every sample has a global
+# grid index g and sits at g * spacing - chunk_size / 2 in world space,
+# which makes the rows and columns two neighbouring chunks share
+# bit-identical, so new grids copy them from resident neighbours instead
+# of sampling them again. Shared between pool threads.
+#
+# Grids are stored with adopt_neighbours(): whichever of two neighbours
+# is stored second takes the shared samples from the first, so seams stay
+# bit-identical even when the grids come from different samplers (the GPU
+# one only matches the CPU within float rounding) or from pool jobs that
+# sampled the same border at the same time.
+#
+# With a ChunkDiskCache set, grids missing from memory are looked up on
+# disk before sampling and every freshly sampled grid is written back.
+
+const apron = 1
+
+var noise
+var chunk_size
+var resolution
+var spacing
+var height_scale
+var grids = {}
+var disk_cache
+var profiler
+var mutex = Mutex.new()
+
+func _init(noise_map, chunk_size, resolution, height_scale):
+	self.noise = noise_map
+	self.chunk_size = chunk_size
+	self.resolution = resolution
+	self.spacing = float(chunk_size) / (resolution - 1)
+	self.height_scale = height_scale
+
+# Samples per side of a stored grid
+func grid_width():
+	return resolution + apron * 2
+
+func get_grid(cell):
+	mutex.lock()
+	var grid = grids.get(cell)
+	mutex.unlock()
+	return grid
+
+# Grids sampled elsewhere (GpuHeightmapSampler, a ChunkService) skip the
+# disk cache, the GPU rebuilds them faster than they load. Their border
+# may be overwritten by resident neighbours.
+func insert(cell, grid):
+	mutex.lock()
+	adopt_neighbours(cell, grid)
+	grids[cell] = grid
+	mutex.unlock()
+
+func erase(cell):
+	mutex.lock()
+	grids.erase(cell)
+	mutex.unlock()
+
+func clear():
+	mutex.lock()
+	grids.clear()
+	mutex.unlock()
+
+func get_or_build(cell):
+	var grid = get_grid(cell)
+	if grid == null:
+		if disk_cache != null:
+			var start = Time.get_ticks_usec()
+			grid = disk_cache.load_grid(cell)
+			if profiler != null and grid != null:
+				profiler.since("disk_load", start)
+		if grid == null:
+			var start = Time.get_ticks_usec()
+			grid = build_grid(cell)
+			if profiler != null:
+				profiler.since("sample", start)
+			if disk_cache != null:
+				disk_cache.store_grid(cell, grid)
+		mutex.lock()
+		adopt_neighbours(cell, grid)
+		grids[cell] = grid
+		mutex.unlock()
+	return grid
+
+# Overwrites the samples grid shares with resident neighbours with
+# theirs. Call with mutex held.
+func adopt_neighbours(cell, grid):
+	var base = Vector2i(grid_base(cell.x), grid_base(cell.y))
+	var filled = PackedByteArray()
+	filled.resize(grid.size())
+	for dz in range(-1, 2):
+		for dx in range(-1, 2):
+			if dx == 0 and dz == 0:
+				continue
+			var neighbour_cell = cell + Vector2i(dx, dz)
+			var neighbour = grids.get(neighbour_cell)
+			if neighbour != null:
+				copy_overlap(grid, filled, base, neighbour, Vector2i(grid_base(neighbour_cell.x), grid_base(neighbour_cell.y)))
+
+# Global index of the first (apron) sample of a cell along one axis
+func grid_base(c):
+	return c * (resolution - 1) - apron
+
+func build_grid(cell):
+	var width = grid_width()
+	var base = Vector2i(grid_base(cell.x), grid_base(cell.y))
+	var grid = PackedFloat32Array()
+	var filled = PackedByteArray()
+	grid.resize(width * width)
+	filled.resize(width * width)
+	filled.fill(0)
+
+	for dz in range(-1, 2):
+		for dx in range(-1, 2):
+			if dx == 0 and dz == 0:
+				continue
+			var neighbour_cell = cell + Vector2i(dx, dz)
+			var neighbour = get_grid(neighbour_cell)
+			if neighbour == null:
+				continue
+			copy_overlap(grid, filled, base, neighbour, Vector2i(grid_base(neighbour_cell.x), grid_base(neighbour_cell.y)))
+
+	# Sample whatever the neighbours did not cover, one row run at a time
+	var half = chunk_size * 0.5
+	for j in range(width):
+		var row = j * width
+		var i = 0
+		while i < width:
+			if filled[row + i]:
+				i += 1
+				continue
+			var run = i
+			while run < width and not filled[row + run]:
+				run += 1
+			var samples = HeightmapSampler.sample_rect(noise, base.x + i, base.y + j, run - i, 1, spacing, -half, height_scale)
+			for s in range(samples.size()):
+				grid[row + i + s] = samples[s]
+			i = run
+
+	return grid
+
+func copy_overlap(grid, filled, base, neighbour, neighbour_base):
+	var width = grid_width()
+	var from_x = max(base.x, neighbour_base.x)
+	var to_x = min(base.x, neighbour_base.x) + width
+	var from_z = max(base.y, neighbour_base.y)
+	var to_z = min(base.y, neighbour_base.y) + width
+
+	for gz in range(from_z, to_z):
+		var row = (gz - base.y) * width - base.x
+		var neighbour_row = (gz - neighbour_base.y) * width - neighbour_base.x
+		for gx in range(from_x, to_x):
+			grid[row + gx] = neighbour[neighbour_row + gx]
+			filled[row + gx] = 1
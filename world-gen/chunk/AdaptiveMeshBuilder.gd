@@ -0,0 +1,176 @@
+# AdaptiveMeshBuilder.gd
+extends RefCounted
+class_name AdaptiveMeshBuilder
+
+# Simplified alternative to HeightfieldMeshBuilder's regular grid, as a
+# right triangulated irregular network (RTIN, the Martini approach). The
+# grid is split into right triangles by repeated bisection of the
+# hypotenuse; every split point remembers the largest height error its
+# subtree would add if it was not split. A mesh only keeps splitting
+# where that error is above max_error world units, so flat seabed ends up
+# as a handful of large triangles.
+#
+# Border samples get an infinite error, so every border vertex is always
+# kept. Neighbouring chunks then share exactly the same border edges at
+# any threshold, and no skirts are needed.
+#
+# Same height grid layout, vertex placement, normals and UVs as
+# HeightfieldMeshBuilder. resolution - 1 has to be a power of two. The
+# triangle table is built once in _init(), build_arrays() only reads it
+# and is safe on pool threads.
+
+var resolution
+var size
+var max_error
+# Hypotenuse end points (ax, ay, bx, by) of every triangle in the hierarchy, leaves last
+var coords = PackedInt32Array()
+var parent_triangles
+
+func _init(resolution, size, max_error):
+	self.resolution = resolution
+	self.size = size
+	self.max_error = max_error
+
+	var tile = resolution - 1
+	var triangles = tile * tile * 2 - 2
+	parent_triangles = triangles - tile * tile
+	coords.resize(triangles * 4)
+	for t in range(triangles):
+		var id = t + 2
+		var ax = 0
+		var ay = 0
+		var bx = 0
+		var by = 0
+		var cx = 0
+		var cy = 0
+		if id & 1:
+			bx = tile
+			by = tile
+			cx = tile
+		else:
+			ax = tile
+			ay = tile
+			cy = tile
+		id >>= 1
+		while id > 1:
+			var mx = (ax + bx) >> 1
+			var my = (ay + by) >> 1
+			if id & 1:
+				bx = ax
+				by = ay
+				ax = cx
+				ay = cy
+			else:
+				ax = bx
+				ay = by
+				bx = cx
+				by = cy
+			cx = mx
+			cy = my
+			id >>= 1
+		coords[t * 4] = ax
+		coords[t * 4 + 1] = ay
+		coords[t * 4 + 2] = bx
+		coords[t * 4 + 3] = by
+
+# Error per grid sample (row major, no apron), children before parents
+func compute_errors(heights):
+	var width = resolution + 2
+	var last = resolution - 1
+	var errors = PackedFloat32Array()
+	errors.resize(resolution * resolution)
+	errors.fill(0.0)
+	# Set before the pass, so the parents of every border sample inherit it
+	for k in range(resolution):
+		errors[k] = INF
+		errors[last * resolution + k] = INF
+		errors[k * resolution] = INF
+		errors[k * resolution + last] = INF
+
+	for t in range(coords.size() / 4 - 1, -1, -1):
+		var ax = coords[t * 4]
+		var ay = coords[t * 4 + 1]
+		var bx = coords[t * 4 + 2]
+		var by = coords[t * 4 + 3]
+		var mx = (ax + bx) >> 1
+		var my = (ay + by) >> 1
+		var cx = mx + my - ay
+		var cy = my + ax - mx
+
+		var interpolated = (heights[(ay + 1) * width + ax + 1] + heights[(by + 1) * width + bx + 1]) * 0.5
+		var error = abs(interpolated - heights[(my + 1) * width + mx + 1])
+		if t < parent_triangles:
+			error = max(error, errors[((ay + cy) >> 1) * resolution + ((ax + cx) >> 1)])
+			error = max(error, errors[((by + cy) >> 1) * resolution + ((bx + cx) >> 1)])
+		var middle = my * resolution + mx
+		errors[middle] = max(errors[middle], error)
+	return errors
+
+func build_arrays(heights, max_error, reuse = null):
+	var tile = resolution - 1
+	var spacing = size / float(tile)
+	var half = size * 0.5
+	var width = resolution + 2
+	var errors = compute_errors(heights)
+
+	# Grid sample indices, three per kept triangle
+	var triangles = []
+	collect(errors, max_error, triangles, 0, 0, tile, tile, tile, 0)
+	collect(errors, max_error, triangles, tile, tile, 0, 0, 0, tile)
+
+	var vertex_of = PackedInt32Array()
+	vertex_of.resize(resolution * resolution)
+	vertex_of.fill(-1)
+	var samples = PackedInt32Array()
+	for g in triangles:
+		if vertex_of[g] < 0:
+			vertex_of[g] = samples.size()
+			samples.append(g)
+
+	var arrays = reuse
+	if arrays == null:
+		arrays = []
+		arrays.resize(Mesh.ARRAY_MAX)
+
+	var vertices = HeightfieldMeshBuilder.take_array(arrays, Mesh.ARRAY_VERTEX, PackedVector3Array())
+	var normals = HeightfieldMeshBuilder.take_array(arrays, Mesh.ARRAY_NORMAL, PackedVector3Array())
+	var uvs = HeightfieldMeshBuilder.take_array(arrays, Mesh.ARRAY_TEX_UV, PackedVector2Array())
+	var indices = HeightfieldMeshBuilder.take_array(arrays, Mesh.ARRAY_INDEX, PackedInt32Array())
+	vertices.resize(samples.size())
+	normals.resize(samples.size())
+	uvs.resize(samples.size())
+	indices.resize(triangles.size())
+
+	for v in range(samples.size()):
+		var i = samples[v] % resolution
+		var j = samples[v] / resolution
+		var h = (j + 1) * width + i + 1
+		var dx = heights[h + 1] - heights[h - 1]
+		var dz = heights[h + width] - heights[h - width]
+
+		vertices[v] = Vector3(i * spacing - half, heights[h], j * spacing - half)
+		normals[v] = Vector3(-dx, 2.0 * spacing, -dz).normalized()
+		uvs[v] = Vector2(i, j) / tile
+
+	for n in range(triangles.size()):
+		indices[n] = vertex_of[triangles[n]]
+
+	arrays[Mesh.ARRAY_VERTEX] = vertices
+	arrays[Mesh.ARRAY_NORMAL] = normals
+	arrays[Mesh.ARRAY_TEX_UV] = uvs
+	arrays[Mesh.ARRAY_INDEX] = indices
+	return arrays
+
+# Splits triangle a, b, c (right angle at c) while its hypotenuse midpoint is off by more than max_error
+func collect(errors, max_error, triangles, ax, ay, bx, by, cx, cy):
+	var mx = (ax + bx) >> 1
+	var my = (ay + by) >> 1
+	if abs(ax - cx) + abs(ay - cy) > 1 and errors[my * resolution + mx] > max_error:
+		collect(errors, max_error, triangles, cx, cy, ax, ay, mx, my)
+		collect(errors, max_error, triangles, bx, by, cx, cy, mx, my)
+		return
+
+	# The bisection winds counter clockwise seen from above, PlaneMesh order is the other way
+	triangles.append(ay * resolution + ax)
+	triangles.append(cy * resolution + cx)
+	triangles.append(by * resolution + bx)
@@ -2,54 +2,121 @@
 extends Node3D
 class_name Chunk
 
+const height_scale = 80
+# One material for every regular chunk mesh, so they all batch under one shader
+const terrain_material = preload("res://world-gen/chunk/terrain_material.tres")
+
 var mesh_instance
-var noise
-var x
-var z
-var chunk_size
+var static_body
+var collision_shape
+# Heights, mesh arrays and accounting, see ChunkData
+var data
+
+func _init(noise_map, x_pos, z_pos, chunk_size, heightmap_cache = null):
+	data = ChunkData.new(noise_map, x_pos, z_pos, chunk_size, heightmap_cache)
+
+# Mesh samples per side, two units apart
+static func grid_resolution(chunk_size):
+	return int(chunk_size * 0.5) + 1
+
+# Heightmap collision straight from the height grid, without the apron. A
+# HeightMapShape3D has one unit between samples, so heights are divided by
+# the sample spacing and the shape node is scaled up uniformly by it.
+# Only reads its arguments, safe on a pool thread.
+static func build_collision_shape(heights, chunk_size):
+	var resolution = grid_resolution(chunk_size)
+	var spacing = float(chunk_size) / (resolution - 1)
+	var width = resolution + 2
+	var map_data = PackedFloat32Array()
+	map_data.resize(resolution * resolution)
+	var v = 0
+	for j in range(resolution):
+		var row = (j + 1) * width + 1
+		for i in range(resolution):
+			map_data[v] = heights[row + i] / spacing
+			v += 1
 
-func _init(noise_map, x_pos, z_pos, chunk_size):
-	self.noise = noise_map
-	self.x = x_pos
-	self.y = z_pos
-	self.chunk_size = chunk_size
+	var shape = HeightMapShape3D.new()
+	shape.map_width = resolution
+	shape.map_depth = resolution
+	shape.map_data = map_data
+	return shape
 
+# world.gd generates chunks on a pool thread before adding them
 func _ready():
-	generate_chunk()
-	
-	
-func generate_chunk():
-	var plane_mesh = PlaneMesh.new()
-	plane_mesh.size = Vector2(chunk_size,chunk_size)
-	plane_mesh.subdivide_depth = chunk_size * 0.5
-	plane_mesh.subdivide_width = chunk_size * 0.5
+	if mesh_instance == null:
+		generate_chunk()
 
-	# TODO give it a material
 
-	var surface_tool = SurfaceTool.new()
-	var data_tool = MeshDataTool.new()
-	surface_tool.create_from(plane_mesh, 0)
-	var array_plane = surface_tool.commit()
-	var error = data_tool.create_from_surface(array_plane, 0)
+func generate_chunk(lod = 0, skirt_depth = 0.0):
+	mesh_instance = MeshInstance3D.new()
+	mesh_instance.cast_shadow = GeometryInstance3D.SHADOW_CASTING_SETTING_OFF
+	mesh_instance.mesh = data.generate(lod, skirt_depth)
+	if data.displaced != null:
+		mesh_instance.material_override = data.displaced.material
+		mesh_instance.custom_aabb = data.aabb
+	else:
+		mesh_instance.material_override = terrain_material
+	add_child(mesh_instance)
 
-	for i in range(data_tool.get_vertex_count()):
-		var vertex = data_tool.get_vertex(i)
+# Only reads the data, so world.gd runs it on a pool thread while the chunk is in the tree
+func build_lod_mesh(lod, skirt_depth):
+	return data.build_lod_mesh(lod, skirt_depth)
 
-		vertex.y = noise.get_noise_3d(vertex.x + x, vertex.y, vertex.z + z) * 80
+func set_lod_mesh(lod, built):
+	data.set_lod(lod, built)
+	mesh_instance.mesh = built[0]
 
-		data_tool.set_vertex(i, vertex)
+func set_height_layer(layer):
+	data.layer = layer
+	mesh_instance.set_instance_shader_parameter("layer", layer)
 
-	for s in range(array_plane.get_surface_count()):
-		array_plane.surface_remove(s)
+# What world.gd hands the collision job, see build_collision_shape()
+func collision_data():
+	return data.heights
 
-	data_tool.commit_to_surface(array_plane)
-	surface_tool.begin(Mesh.PRIMITIVE_TRIANGLES)
-	surface_tool.create_from(array_plane, 0)
-	surface_tool.generate_normals()
+func has_collision():
+	return collision_shape != null and not collision_shape.disabled
 
-	mesh_instance = MeshInstance3D.new()
-	mesh_instance.mesh = surface_tool.commit()
-	mesh_instance.create_trimesh_collision()
-	mesh_instance.cast_shadow = GeometryInstance3D.SHADOW_CASTING_SETTING_OFF
-	add_child(mesh_instance)
+# world.gd builds the shape on a pool thread and only hands it over here
+func set_collision_shape(shape):
+	if static_body == null:
+		static_body = StaticBody3D.new()
+		collision_shape = CollisionShape3D.new()
+		var spacing = float(data.chunk_size) / (grid_resolution(data.chunk_size) - 1)
+		collision_shape.scale = Vector3(spacing, spacing, spacing)
+		static_body.add_child(collision_shape)
+		add_child(static_body)
+
+	collision_shape.shape = shape
+	collision_shape.disabled = false
+	data.collision_bytes = shape.map_data.size() * 4
+
+func clear_collision():
+	if collision_shape != null:
+		collision_shape.disabled = true
+		collision_shape.shape = null
+	data.collision_bytes = 0
+
+# Drawn or not while resident, collision stays as it is
+func set_shown(shown):
+	visible = shown
+
+# Pooled chunks stay in the tree, hidden and without collision, until recycled
+func park():
+	visible = false
+	clear_collision()
+
+# Runs on a pool thread while the chunk is parked, the nodes stay untouched
+func prepare_recycle(x_pos, z_pos, lod, skirt_depth):
+	data.prepare_recycle(x_pos, z_pos, lod, skirt_depth)
+
+func apply_recycle():
+	mesh_instance.mesh = data.apply_recycle(mesh_instance.mesh)
+	if data.displaced != null:
+		mesh_instance.custom_aabb = data.aabb
+	position = Vector3(data.x, 0, data.z)
+	visible = true
 
+func get_memory_bytes():
+	return data.get_memory_bytes()
@@ -0,0 +1,189 @@
+# ChunkData.gd
+extends RefCounted
+class_name ChunkData
+
+# Everything a chunk computes and keeps, whatever draws it: the height
+# grid, the mesh arrays per LOD, recycling into another cell and memory
+# accounting. Chunk (scene tree nodes) and ServerChunk (RenderingServer
+# and PhysicsServer3D RIDs) each own one and only add the part that puts
+# it on screen and into physics. Everything but apply_recycle() runs on
+# pool threads while the owner is not resident or only reads it.
+
+var noise
+var x
+var z
+var chunk_size
+var heightmap_cache
+var heights
+var lod = 0
+var last_used = 0
+var mesh_arrays
+var surface_vertex_count = 0
+var surface_index_count = 0
+var collision_bytes = 0
+# Filled on a pool thread by prepare_recycle(), applied by apply_recycle()
+var recycled = {}
+# Set by world.gd in displaced_mode, the chunk then draws a shared grid from its height layer
+var displaced
+var layer = -1
+var height_image
+# Height range of a displaced chunk, its shared grid mesh is flat
+var aabb = AABB()
+# ChunkProfiler from world.gd, null when not profiling
+var profiler
+# AdaptiveMeshBuilder from world.gd, null for regular grids
+var adaptive
+# Compressed vertex attributes, see HeightfieldMeshBuilder.add_surface()
+var compress = false
+
+func _init(noise_map, x_pos, z_pos, chunk_size, heightmap_cache = null):
+	self.noise = noise_map
+	self.x = x_pos
+	self.z = z_pos
+	self.chunk_size = chunk_size
+	self.heightmap_cache = heightmap_cache
+
+func cell():
+	return Vector2i(x / chunk_size, z / chunk_size)
+
+# Heights for the cell and the mesh to draw at lod: a new ArrayMesh, or the
+# shared grid in displaced_mode
+func generate(lod, skirt_depth):
+	heights = sample_heights(cell())
+	self.lod = lod
+	if displaced != null:
+		# world.gd uploads height_image into a layer once the chunk is resident
+		height_image = DisplacedTerrain.height_image(heights, displaced.width)
+		aabb = displaced.height_aabb(heights)
+		return displaced.grid_mesh(lod)
+
+	mesh_arrays = build_lod_arrays(heights, lod, skirt_depth)
+	update_counts(mesh_arrays)
+	return make_mesh(mesh_arrays)
+
+func sample_heights(cell):
+	if heightmap_cache != null:
+		return heightmap_cache.get_or_build(cell)
+
+	var resolution = Chunk.grid_resolution(chunk_size)
+	var spacing = float(chunk_size) / (resolution - 1)
+	return HeightmapSampler.sample_grid(noise, cell.x * (resolution - 1) - 1, cell.y * (resolution - 1) - 1, resolution + 2, spacing, -chunk_size * 0.5, Chunk.height_scale)
+
+func build_lod_arrays(heights, lod, skirt_depth, reuse = null):
+	var start = Time.get_ticks_usec()
+	var arrays
+	if adaptive != null:
+		# Coarser LODs accept proportionally more error instead of dropping samples
+		arrays = adaptive.build_arrays(heights, adaptive.max_error * (1 << lod), reuse)
+	else:
+		arrays = HeightfieldMeshBuilder.build_arrays(heights, Chunk.grid_resolution(chunk_size), chunk_size, 1 << lod, skirt_depth, reuse)
+	profile("mesh", start)
+	return arrays
+
+func make_mesh(arrays):
+	var start = Time.get_ticks_usec()
+	var mesh = ArrayMesh.new()
+	HeightfieldMeshBuilder.add_surface(mesh, arrays, compress)
+	profile("upload", start)
+	return mesh
+
+func profile(stage, start):
+	if profiler != null:
+		profiler.since(stage, start)
+
+# Only reads heights, so world.gd runs it on a pool thread while the chunk is resident
+func build_lod_mesh(lod, skirt_depth):
+	if displaced != null:
+		return [displaced.grid_mesh(lod), null]
+
+	var arrays = build_lod_arrays(heights, lod, skirt_depth)
+	return [make_mesh(arrays), arrays]
+
+func set_lod(lod, built):
+	self.lod = lod
+	mesh_arrays = built[1]
+	update_counts(mesh_arrays)
+
+func update_counts(arrays):
+	if arrays == null:
+		surface_vertex_count = 0
+		surface_index_count = 0
+		return
+	surface_vertex_count = arrays[Mesh.ARRAY_VERTEX].size()
+	surface_index_count = arrays[Mesh.ARRAY_INDEX].size()
+
+# Runs on a pool thread while the owner is parked. Rebuilds everything for
+# the new cell into the existing arrays.
+func prepare_recycle(x_pos, z_pos, lod, skirt_depth):
+	var next_heights = sample_heights(Vector2i(x_pos / chunk_size, z_pos / chunk_size))
+	if displaced != null:
+		recycled = {
+			"x": x_pos,
+			"z": z_pos,
+			"lod": lod,
+			"heights": next_heights,
+			"image": DisplacedTerrain.height_image(next_heights, displaced.width),
+			"aabb": displaced.height_aabb(next_heights),
+		}
+		return
+
+	var arrays = build_lod_arrays(next_heights, lod, skirt_depth, mesh_arrays)
+
+	# Same LOD means the same layout, so the GPU buffers can be overwritten in place.
+	# Not with compression: positions are encoded against the surface AABB,
+	# which a region update leaves as it was. Not for adaptive meshes either,
+	# equal counts there still come with a different triangulation.
+	var surface = null
+	if not compress and adaptive == null and arrays[Mesh.ARRAY_VERTEX].size() == surface_vertex_count and arrays[Mesh.ARRAY_INDEX].size() == surface_index_count:
+		var start = Time.get_ticks_usec()
+		surface = RenderingServer.mesh_create_surface_data_from_arrays(Mesh.PRIMITIVE_TRIANGLES, arrays)
+		profile("upload", start)
+
+	recycled = {
+		"x": x_pos,
+		"z": z_pos,
+		"lod": lod,
+		"heights": next_heights,
+		"arrays": arrays,
+		"surface": surface,
+	}
+
+# Main thread. Moves to the recycled cell and refills mesh, the owner's
+# ArrayMesh; returns the mesh to draw from now on.
+func apply_recycle(mesh):
+	x = recycled.x
+	z = recycled.z
+	lod = recycled.lod
+	heights = recycled.heights
+
+	if displaced != null:
+		# Only the layer changes, world.gd uploads height_image right after
+		height_image = recycled.image
+		aabb = recycled.aabb
+		recycled = {}
+		return displaced.grid_mesh(lod)
+
+	mesh_arrays = recycled.arrays
+	var start = Time.get_ticks_usec()
+	var surface = recycled.surface
+	if surface != null:
+		var rid = mesh.get_rid()
+		RenderingServer.mesh_surface_update_vertex_region(rid, 0, 0, surface["vertex_data"])
+		if not surface["attribute_data"].is_empty():
+			RenderingServer.mesh_surface_update_attribute_region(rid, 0, 0, surface["attribute_data"])
+		# The surface keeps the AABB it was created with
+		mesh.custom_aabb = surface["aabb"]
+	else:
+		mesh.clear_surfaces()
+		mesh.custom_aabb = AABB()
+		HeightfieldMeshBuilder.add_surface(mesh, mesh_arrays, compress)
+	profile("upload", start)
+
+	update_counts(mesh_arrays)
+	recycled = {}
+	return mesh
+
+# Rough CPU side footprint: height grid, mesh arrays and collision heights
+func get_memory_bytes():
+	# Position and normal Vector3s, one UV Vector2 and a 32 bit index
+	return heights.size() * 4 + surface_vertex_count * 32 + surface_index_count * 4 + collision_bytes
@@ -0,0 +1,91 @@
+# DisplacedTerrain.gd
+extends RefCounted
+class_name DisplacedTerrain
+
+# Rendering side of world.gd's displaced_mode. Every chunk draws the same
+# flat grid mesh for its LOD (skirts included) and only owns one layer of
+# a shared Texture2DArray holding its height grid with the apron; the
+# vertex shader in displaced_terrain.gdshader lifts the grid and derives
+# the normals. A chunk then costs a 35x35 float layer on the GPU instead
+# of its own vertex and index buffers, and swapping it to another cell is
+# a layer upload instead of a mesh rebuild.
+#
+# The grid meshes are built up front and never change, so pool threads
+# may hand them out. Layers are handed out and uploaded on the main thread.
+
+const shader = preload("res://world-gen/chunk/displaced_terrain.gdshader")
+
+var chunk_size
+var resolution
+var width
+var skirt_depth
+var grid_meshes = []
+var material
+var texture
+var free_layers = []
+
+func _init(chunk_size, lod_count, skirt_depth, layer_count):
+	self.chunk_size = chunk_size
+	self.skirt_depth = skirt_depth
+	resolution = Chunk.grid_resolution(chunk_size)
+	width = resolution + HeightmapCache.apron * 2
+
+	var flat = PackedFloat32Array()
+	flat.resize(width * width)
+	flat.fill(0.0)
+	for lod in range(lod_count):
+		grid_meshes.append(HeightfieldMeshBuilder.build_mesh(flat, resolution, chunk_size, 1 << lod, skirt_depth))
+
+	var blank = Image.create(width, width, false, Image.FORMAT_RF)
+	var images = []
+	images.resize(layer_count)
+	images.fill(blank)
+	texture = Texture2DArray.new()
+	texture.create_from_images(images)
+	for layer in range(layer_count - 1, -1, -1):
+		free_layers.append(layer)
+
+	material = ShaderMaterial.new()
+	material.shader = shader
+	material.set_shader_parameter("heights", texture)
+	material.set_shader_parameter("spacing", float(chunk_size) / (resolution - 1))
+	material.set_shader_parameter("cells", float(resolution - 1))
+
+# Largest layer_count the renderer takes. The compatibility renderer has
+# no RenderingDevice to ask, 256 is what GLES3 guarantees.
+static func max_layers():
+	var rd = RenderingServer.get_rendering_device()
+	if rd == null:
+		return 256
+	return rd.limit_get(RenderingDevice.LIMIT_MAX_TEXTURE_ARRAY_LAYERS)
+
+func grid_mesh(lod):
+	return grid_meshes[min(lod, grid_meshes.size() - 1)]
+
+static func height_image(heights, width):
+	return Image.create_from_data(width, width, false, Image.FORMAT_RF, heights.to_byte_array())
+
+# The shared mesh is flat, so culling needs the real height range per chunk
+func height_aabb(heights):
+	var low = INF
+	var high = -INF
+	for h in heights:
+		low = min(low, h)
+		high = max(high, h)
+	var half = chunk_size * 0.5
+	return AABB(Vector3(-half, low - skirt_depth, -half), Vector3(chunk_size, high - low + skirt_depth, chunk_size))
+
+# Main thread only, writes chunk.data.height_image into the chunk's layer
+func upload(chunk):
+	if chunk.data.layer < 0:
+		if free_layers.is_empty():
+			push_error("DisplacedTerrain is out of height layers")
+			return
+		chunk.set_height_layer(free_layers.pop_back())
+	texture.update_layer(chunk.data.height_image, chunk.data.layer)
+	chunk.data.height_image = null
+
+func release_layer(chunk):
+	if chunk.data.layer >= 0:
+		free_layers.append(chunk.data.layer)
+		chunk.data.layer = -1
@@ -0,0 +1,128 @@
+# HeightfieldMeshBuilder.gd
+extends RefCounted
+class_name HeightfieldMeshBuilder
+
+# Builds a chunk surface straight from a square height grid, no
+# PlaneMesh, SurfaceTool or MeshDataTool in between. heights is row major
+# (z rows of x samples) with a one sample apron around the
+# resolution^2 mesh samples, the mesh spreads over size units centred on
+# the origin like a PlaneMesh and normals use the apron so they match the
+# neighbouring chunk along the seam. Safe to call from pool threads.
+#
+# step > 1 keeps every step-th sample for a coarser LOD, resolution - 1
+# has to be a multiple of it. skirt_depth > 0 hangs a strip that deep
+# below the border so cracks against a neighbour at another LOD stay
+# hidden.
+#
+# Passing the arrays of an earlier build as reuse refills its packed
+# arrays in place instead of allocating new ones.
+#
+# add_surface() with compress on stores positions as 16 bit fractions of
+# the surface AABB, normals octahedral and UVs as 16 bit, 16 instead of
+# 24 bytes a vertex. Indices are 16 bit either way, the RenderingServer
+# picks that format itself below 65536 vertices and a chunk has ~1200.
+
+static func lod_resolution(resolution, step):
+	return (resolution - 1) / step + 1
+
+static func build_arrays(heights, resolution, size, step = 1, skirt_depth = 0.0, reuse = null):
+	var spacing = size / float(resolution - 1)
+	var half = size * 0.5
+	var width = resolution + 2
+	var lod_res = lod_resolution(resolution, step)
+	var cells = lod_res - 1
+	var vertex_count = lod_res * lod_res
+	var skirt_count = cells * 4 if skirt_depth > 0.0 else 0
+
+	var arrays = reuse
+	if arrays == null:
+		arrays = []
+		arrays.resize(Mesh.ARRAY_MAX)
+
+	var vertices = take_array(arrays, Mesh.ARRAY_VERTEX, PackedVector3Array())
+	var normals = take_array(arrays, Mesh.ARRAY_NORMAL, PackedVector3Array())
+	var uvs = take_array(arrays, Mesh.ARRAY_TEX_UV, PackedVector2Array())
+	var indices = take_array(arrays, Mesh.ARRAY_INDEX, PackedInt32Array())
+	vertices.resize(vertex_count + skirt_count)
+	normals.resize(vertex_count + skirt_count)
+	uvs.resize(vertex_count + skirt_count)
+
+	var v = 0
+	for j in range(lod_res):
+		for i in range(lod_res):
+			var h = (j * step + 1) * width + i * step + 1
+			# Full resolution differences, so every LOD agrees on the normal
+			var dx = heights[h + 1] - heights[h - 1]
+			var dz = heights[h + width] - heights[h - width]
+
+			vertices[v] = Vector3(i * step * spacing - half, heights[h], j * step * spacing - half)
+			normals[v] = Vector3(-dx, 2.0 * spacing, -dz).normalized()
+			uvs[v] = Vector2(i, j) / cells
+			v += 1
+
+	indices.resize(cells * cells * 6 + skirt_count * 6)
+	var n = 0
+	for j in range(cells):
+		for i in range(cells):
+			var v00 = j * lod_res + i
+			var v10 = v00 + 1
+			var v01 = v00 + lod_res
+			var v11 = v01 + 1
+			# Clockwise seen from above, same order as PlaneMesh
+			indices[n] = v00
+			indices[n + 1] = v10
+			indices[n + 2] = v01
+			indices[n + 3] = v10
+			indices[n + 4] = v11
+			indices[n + 5] = v01
+			n += 6
+
+	if skirt_count > 0:
+		# Border walked clockwise seen from above, so one winding faces out on every side
+		var border = PackedInt32Array()
+		for i in range(cells):
+			border.append(i)
+		for j in range(cells):
+			border.append(j * lod_res + cells)
+		for i in range(cells, 0, -1):
+			border.append(cells * lod_res + i)
+		for j in range(cells, 0, -1):
+			border.append(j * lod_res)
+
+		for k in range(skirt_count):
+			var top = border[k]
+			vertices[vertex_count + k] = vertices[top] - Vector3(0, skirt_depth, 0)
+			normals[vertex_count + k] = normals[top]
+			uvs[vertex_count + k] = uvs[top]
+
+		for k in range(skirt_count):
+			var next = (k + 1) % skirt_count
+			indices[n] = border[k]
+			indices[n + 1] = vertex_count + k
+			indices[n + 2] = border[next]
+			indices[n + 3] = border[next]
+			indices[n + 4] = vertex_count + k
+			indices[n + 5] = vertex_count + next
+			n += 6
+
+	arrays[Mesh.ARRAY_VERTEX] = vertices
+	arrays[Mesh.ARRAY_NORMAL] = normals
+	arrays[Mesh.ARRAY_TEX_UV] = uvs
+	arrays[Mesh.ARRAY_INDEX] = indices
+	return arrays
+
+# Packed arrays are copy on write, so one is only refilled in place once
+# the array slot no longer shares it
+static func take_array(arrays, slot, empty):
+	var packed = arrays[slot]
+	arrays[slot] = null
+	return empty if packed == null else packed
+
+static func add_surface(mesh, arrays, compress = false):
+	var flags = Mesh.ARRAY_FLAG_COMPRESS_ATTRIBUTES if compress else 0
+	mesh.add_surface_from_arrays(Mesh.PRIMITIVE_TRIANGLES, arrays, [], {}, flags)
+
+static func build_mesh(heights, resolution, size, step = 1, skirt_depth = 0.0, compress = false):
+	var mesh = ArrayMesh.new()
+	add_surface(mesh, build_arrays(heights, resolution, size, step, skirt_depth), compress)
+	return mesh
@@ -0,0 +1,32 @@
+# HeightmapSampler.gd
+extends RefCounted
+class_name HeightmapSampler
+
+# Fills a whole height grid in one call instead of one noise lookup per
+# mesh vertex from the chunk. Samples live on a global lattice: sample
+# (i, j) sits at ((index_x + i) * spacing + offset, 0,
+# (index_z + j) * spacing + offset), row major in z, so the same lattice
+# point always gets the same coordinates and the same value no matter
+# which grid asked for it. Values come from the caller's noise, so the
+# terrain matches what get_noise_3d gives everywhere else, or from a
+# prepared NoiseGraph, which takes the whole rect at once. Safe to call
+# from pool threads.
+
+static func sample_grid(noise, index_x, index_z, resolution, spacing, offset, height_scale):
+	return sample_rect(noise, index_x, index_z, resolution, resolution, spacing, offset, height_scale)
+
+static func sample_rect(noise, index_x, index_z, width, depth, spacing, offset, height_scale):
+	if noise is NoiseGraph:
+		return noise.sample_rect(index_x, index_z, width, depth, spacing, offset, height_scale)
+
+	var heights = PackedFloat32Array()
+	heights.resize(width * depth)
+
+	var v = 0
+	for j in range(depth):
+		var sample_z = (index_z + j) * spacing + offset
+		for i in range(width):
+			heights[v] = noise.get_noise_3d((index_x + i) * spacing + offset, 0.0, sample_z) * height_scale
+			v += 1
+
+	return heights
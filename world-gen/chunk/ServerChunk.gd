@@ -0,0 +1,111 @@
+# ServerChunk.gd
+extends RefCounted
+class_name ServerChunk
+
+# Node free stand-in for Chunk used by world.gd's server_mode. The mesh is
+# drawn through a RenderingServer instance and collision lives on a
+# PhysicsServer3D static body, so a resident chunk costs no scene tree
+# nodes, notifications or transform propagation. It answers the same
+# calls world.gd makes on a Chunk; attach() and release() replace
+# add_child() and free().
+
+# Heights, mesh arrays and accounting, see ChunkData
+var data
+var mesh
+var instance = RID()
+var body = RID()
+var shape
+var space = RID()
+
+func _init(noise_map, x_pos, z_pos, chunk_size, heightmap_cache = null):
+	data = ChunkData.new(noise_map, x_pos, z_pos, chunk_size, heightmap_cache)
+
+func generate_chunk(lod = 0, skirt_depth = 0.0):
+	mesh = data.generate(lod, skirt_depth)
+
+func build_lod_mesh(lod, skirt_depth):
+	return data.build_lod_mesh(lod, skirt_depth)
+
+func get_transform():
+	return Transform3D(Basis(), Vector3(data.x, 0, data.z))
+
+# Main thread only, creates the render instance in the given world
+func attach(world_3d):
+	if instance.is_valid():
+		return
+
+	space = world_3d.space
+	instance = RenderingServer.instance_create2(mesh.get_rid(), world_3d.scenario)
+	RenderingServer.instance_set_transform(instance, get_transform())
+	RenderingServer.instance_geometry_set_cast_shadows_setting(instance, RenderingServer.SHADOW_CASTING_SETTING_OFF)
+	if data.displaced != null:
+		RenderingServer.instance_geometry_set_material_override(instance, data.displaced.material.get_rid())
+		RenderingServer.instance_set_custom_aabb(instance, data.aabb)
+	else:
+		RenderingServer.instance_geometry_set_material_override(instance, Chunk.terrain_material.get_rid())
+
+func release():
+	clear_collision()
+	if instance.is_valid():
+		RenderingServer.free_rid(instance)
+		instance = RID()
+	mesh = null
+
+func set_lod_mesh(lod, built):
+	data.set_lod(lod, built)
+	mesh = built[0]
+	RenderingServer.instance_set_base(instance, mesh.get_rid())
+	if data.displaced != null:
+		RenderingServer.instance_set_custom_aabb(instance, data.aabb)
+
+func set_height_layer(layer):
+	data.layer = layer
+	RenderingServer.instance_geometry_set_shader_parameter(instance, "layer", layer)
+
+func collision_data():
+	return data.heights
+
+func has_collision():
+	return body.is_valid()
+
+func set_collision_shape(shape):
+	clear_collision()
+	self.shape = shape
+	var spacing = float(data.chunk_size) / (Chunk.grid_resolution(data.chunk_size) - 1)
+	body = PhysicsServer3D.body_create()
+	PhysicsServer3D.body_set_mode(body, PhysicsServer3D.BODY_MODE_STATIC)
+	PhysicsServer3D.body_add_shape(body, shape.get_rid(), Transform3D(Basis().scaled(Vector3(spacing, spacing, spacing)), Vector3.ZERO))
+	PhysicsServer3D.body_set_state(body, PhysicsServer3D.BODY_STATE_TRANSFORM, get_transform())
+	PhysicsServer3D.body_set_space(body, space)
+	data.collision_bytes = shape.map_data.size() * 4
+
+func clear_collision():
+	if body.is_valid():
+		PhysicsServer3D.free_rid(body)
+		body = RID()
+	shape = null
+	data.collision_bytes = 0
+
+func set_shown(shown):
+	RenderingServer.instance_set_visible(instance, shown)
+
+func park():
+	RenderingServer.instance_set_visible(instance, false)
+	clear_collision()
+
+# Runs on a pool thread while parked
+func prepare_recycle(x_pos, z_pos, lod, skirt_depth):
+	data.prepare_recycle(x_pos, z_pos, lod, skirt_depth)
+
+func apply_recycle():
+	var next_mesh = data.apply_recycle(mesh)
+	if next_mesh != mesh:
+		mesh = next_mesh
+		RenderingServer.instance_set_base(instance, mesh.get_rid())
+	if data.displaced != null:
+		RenderingServer.instance_set_custom_aabb(instance, data.aabb)
+	RenderingServer.instance_set_transform(instance, get_transform())
+	RenderingServer.instance_set_visible(instance, true)
+
+func get_memory_bytes():
+	return data.get_memory_bytes()
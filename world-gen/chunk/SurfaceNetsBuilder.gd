@@ -0,0 +1,114 @@
+# SurfaceNetsBuilder.gd
+extends RefCounted
+class_name SurfaceNetsBuilder
+
+# Surface Nets over a block of density samples, solid where positive.
+# density is (layer * width + z) * width + x with one sample of apron
+# before the chunk on x and z, so sample (i, k, j) sits at
+# ((i - 1) * spacing - half, (bottom + k) * spacing, (j - 1) * spacing - half).
+# Every cell with a sign change gets one vertex, the average of its edge
+# crossings, and every sign changing sample edge a quad between the four
+# cells around it.
+#
+# A chunk only emits the quads of edges starting on its own samples
+# (0 .. width - 3 on x and z), the apron cells just supply vertices.
+# Neighbours sample the same world positions, so they derive the same
+# vertices on their shared cells and the surface closes across the seam.
+# The bottom two layers have to be solid and the top two empty, no quads
+# are looked for there.
+#
+# Returns null when nothing crosses the surface. Safe on pool threads.
+
+# Corner k is x = k & 1, z = (k >> 1) & 1, y = k >> 2
+const corners = [Vector3(0, 0, 0), Vector3(1, 0, 0), Vector3(0, 0, 1), Vector3(1, 0, 1),
+	Vector3(0, 1, 0), Vector3(1, 1, 0), Vector3(0, 1, 1), Vector3(1, 1, 1)]
+const edges = [0, 1, 2, 3, 4, 5, 6, 7, 0, 2, 1, 3, 4, 6, 5, 7, 0, 4, 1, 5, 2, 6, 3, 7]
+
+static func build_arrays(density, width, layers, spacing, bottom, half, reuse = null):
+	var cells = width - 1
+	var plane = width * width
+	var offsets = [0, 1, width, width + 1, plane, plane + 1, plane + width, plane + width + 1]
+	var cell_vertex = PackedInt32Array()
+	cell_vertex.resize(cells * cells * (layers - 1))
+	cell_vertex.fill(-1)
+
+	var arrays = reuse
+	if arrays == null:
+		arrays = []
+		arrays.resize(Mesh.ARRAY_MAX)
+	var vertices = HeightfieldMeshBuilder.take_array(arrays, Mesh.ARRAY_VERTEX, PackedVector3Array())
+	var normals = HeightfieldMeshBuilder.take_array(arrays, Mesh.ARRAY_NORMAL, PackedVector3Array())
+	var indices = HeightfieldMeshBuilder.take_array(arrays, Mesh.ARRAY_INDEX, PackedInt32Array())
+	vertices.clear()
+	normals.clear()
+	indices.clear()
+	arrays[Mesh.ARRAY_TEX_UV] = null
+
+	var values = PackedFloat32Array()
+	values.resize(8)
+	var c = 0
+	for y in range(layers - 1):
+		for z in range(cells):
+			for x in range(cells):
+				var base = (y * width + z) * width + x
+				var mask = 0
+				for k in range(8):
+					values[k] = density[base + offsets[k]]
+					if values[k] > 0.0:
+						mask |= 1 << k
+				if mask == 0 or mask == 255:
+					c += 1
+					continue
+
+				var crossing = Vector3.ZERO
+				var count = 0
+				for e in range(0, edges.size(), 2):
+					var a = values[edges[e]]
+					var b = values[edges[e + 1]]
+					if (a > 0.0) != (b > 0.0):
+						crossing += corners[edges[e]].lerp(corners[edges[e + 1]], a / (a - b))
+						count += 1
+				crossing /= count
+				var gradient = Vector3(
+					values[1] + values[3] + values[5] + values[7] - values[0] - values[2] - values[4] - values[6],
+					values[4] + values[5] + values[6] + values[7] - values[0] - values[1] - values[2] - values[3],
+					values[2] + values[3] + values[6] + values[7] - values[0] - values[1] - values[4] - values[5])
+
+				cell_vertex[c] = vertices.size()
+				vertices.append(Vector3((x + crossing.x - 1) * spacing - half, (bottom + y + crossing.y) * spacing, (z + crossing.z - 1) * spacing - half))
+				normals.append(Vector3.UP if gradient == Vector3.ZERO else -gradient.normalized())
+				c += 1
+
+	var owned = width - 2
+	for y in range(1, layers - 1):
+		for z in range(1, owned + 1):
+			for x in range(1, owned + 1):
+				var s = (y * width + z) * width + x
+				var solid = density[s] > 0.0
+				# Cells are indexed like samples without the last one per axis
+				var cell = (y * cells + z) * cells + x
+				if (density[s + 1] > 0.0) != solid:
+					add_quad(indices, cell_vertex, cell - cells * cells - cells, cell - cells, cell, cell - cells * cells, solid)
+				if (density[s + plane] > 0.0) != solid:
+					add_quad(indices, cell_vertex, cell - cells - 1, cell - 1, cell, cell - cells, solid)
+				if (density[s + width] > 0.0) != solid:
+					add_quad(indices, cell_vertex, cell - cells * cells - 1, cell - cells * cells, cell, cell - 1, solid)
+
+	if indices.is_empty():
+		return null
+	arrays[Mesh.ARRAY_VERTEX] = vertices
+	arrays[Mesh.ARRAY_NORMAL] = normals
+	arrays[Mesh.ARRAY_INDEX] = indices
+	return arrays
+
+# a, b, c, d wind counter clockwise seen from the positive end of the edge,
+# front faces here are clockwise from outside like everywhere else
+static func add_quad(indices, cell_vertex, a, b, c, d, solid):
+	a = cell_vertex[a]
+	b = cell_vertex[b]
+	c = cell_vertex[c]
+	d = cell_vertex[d]
+	if solid:
+		indices.append_array(PackedInt32Array([a, d, c, a, c, b]))
+	else:
+		indices.append_array(PackedInt32Array([a, b, c, a, c, d]))
@@ -0,0 +1,134 @@
+# VoxelChunk.gd
+extends Chunk
+class_name VoxelChunk
+
+# Chunk for world.gd's voxel_mode: the same cell, height grid and
+# HeightmapCache as a Chunk, but the mesh is Surface Nets over a
+# VoxelField density block, so overhangs and caves exist. LOD n samples
+# the block 2^n times coarser (height columns included) and neighbours
+# at the same LOD close exactly, but there are no skirts between LODs, so
+# world.gd keeps every voxel chunk at LOD 0. The block is thrown away
+# once meshed.
+# Collision is a ConcavePolygonShape3D of the mesh triangles. A chunk
+# where nothing crosses the surface has no mesh and no collision.
+
+var field
+
+func generate_chunk(lod = 0, skirt_depth = 0.0):
+	data.heights = data.sample_heights(data.cell())
+	data.lod = lod
+
+	mesh_instance = MeshInstance3D.new()
+	mesh_instance.cast_shadow = GeometryInstance3D.SHADOW_CASTING_SETTING_OFF
+	mesh_instance.material_override = terrain_material
+	data.mesh_arrays = build_voxel_arrays(data.cell(), data.heights, lod)
+	mesh_instance.mesh = make_mesh(data.mesh_arrays)
+	add_child(mesh_instance)
+	data.update_counts(data.mesh_arrays)
+
+func build_voxel_arrays(cell, heights, lod, reuse = null):
+	var start = Time.get_ticks_usec()
+	var chunk_size = data.chunk_size
+	var step = 1 << lod
+	var resolution = grid_resolution(chunk_size)
+	var cells = (resolution - 1) / step
+	var width = cells + 2
+	var spacing = float(chunk_size) / cells
+	var half = chunk_size * 0.5
+
+	# Columns from one before the chunk up to its last sample
+	var columns
+	if step == 1:
+		columns = PackedFloat32Array()
+		columns.resize(width * width)
+		for j in range(width):
+			for i in range(width):
+				columns[j * width + i] = heights[j * (resolution + 2) + i]
+	else:
+		columns = HeightmapSampler.sample_rect(data.noise, cell.x * cells - 1, cell.y * cells - 1, width, width, spacing, -half, height_scale)
+
+	var origin = Vector2(cell.x * chunk_size - half - spacing, cell.y * chunk_size - half - spacing)
+	var block = field.fill(columns, width, spacing, origin)
+	var arrays = SurfaceNetsBuilder.build_arrays(block.density, width, block.layers, spacing, block.bottom, half, reuse)
+	data.profile("mesh", start)
+	return arrays
+
+func make_mesh(arrays):
+	if arrays == null:
+		return null
+	var start = Time.get_ticks_usec()
+	var mesh = ArrayMesh.new()
+	HeightfieldMeshBuilder.add_surface(mesh, arrays)
+	data.profile("upload", start)
+	return mesh
+
+func build_lod_mesh(lod, skirt_depth):
+	var arrays = build_voxel_arrays(data.cell(), data.heights, lod)
+	return [make_mesh(arrays), arrays]
+
+# Own copies of the vertices and indices, taken on the main thread:
+# recycling refills the packed arrays the chunk holds on a pool thread
+func collision_data():
+	if data.mesh_arrays == null:
+		return null
+	var faces = []
+	faces.resize(Mesh.ARRAY_MAX)
+	faces[Mesh.ARRAY_VERTEX] = data.mesh_arrays[Mesh.ARRAY_VERTEX].duplicate()
+	faces[Mesh.ARRAY_INDEX] = data.mesh_arrays[Mesh.ARRAY_INDEX].duplicate()
+	return faces
+
+# Triangle soup of a chunk's mesh arrays, null without any. Only reads
+# the arrays, so world.gd runs it on a pool thread.
+static func build_mesh_collision_shape(arrays):
+	if arrays == null:
+		return null
+	var vertices = arrays[Mesh.ARRAY_VERTEX]
+	var indices = arrays[Mesh.ARRAY_INDEX]
+	var faces = PackedVector3Array()
+	faces.resize(indices.size())
+	for i in range(indices.size()):
+		faces[i] = vertices[indices[i]]
+	var shape = ConcavePolygonShape3D.new()
+	shape.set_faces(faces)
+	return shape
+
+# Nothing to collide with in an empty chunk, so it never asks for a shape
+func has_collision():
+	return data.mesh_arrays == null or super()
+
+func set_collision_shape(shape):
+	if shape == null:
+		return
+	if static_body == null:
+		static_body = StaticBody3D.new()
+		collision_shape = CollisionShape3D.new()
+		static_body.add_child(collision_shape)
+		add_child(static_body)
+
+	collision_shape.shape = shape
+	collision_shape.disabled = false
+	data.collision_bytes = data.surface_index_count * 12
+
+func prepare_recycle(x_pos, z_pos, lod, skirt_depth):
+	var cell = Vector2i(x_pos / data.chunk_size, z_pos / data.chunk_size)
+	var next_heights = data.sample_heights(cell)
+	data.recycled = {
+		"x": x_pos,
+		"z": z_pos,
+		"lod": lod,
+		"heights": next_heights,
+		"arrays": build_voxel_arrays(cell, next_heights, lod, data.mesh_arrays),
+	}
+
+func apply_recycle():
+	var recycled = data.recycled
+	data.x = recycled.x
+	data.z = recycled.z
+	data.lod = recycled.lod
+	data.heights = recycled.heights
+	data.mesh_arrays = recycled.arrays
+	data.recycled = {}
+	position = Vector3(data.x, 0, data.z)
+	mesh_instance.mesh = make_mesh(data.mesh_arrays)
+	data.update_counts(data.mesh_arrays)
+	visible = true
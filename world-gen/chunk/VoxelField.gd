@@ -0,0 +1,69 @@
+# VoxelField.gd
+extends RefCounted
+class_name VoxelField
+
+# Density field of world.gd's voxel_mode, solid where positive: the height
+# field minus y, pushed in and out by a 3D noise for overhangs, with
+# tunnels carved by a second 3D noise in a band under the surface that
+# pinch off further down. The noise only reaches overhang above a column
+# and reach() below it, so a block is only sampled between those bounds
+# of its lowest and highest column; everything under is known solid and
+# everything over known empty without a single noise call.
+
+var overhang = 6.0
+var cave_depth = 30.0
+# Tunnels are where |cave noise| < cave_width, cave_scale turns that into world units
+var cave_width = 0.08
+var cave_scale = 40.0
+var overhang_noise
+var cave_noise
+
+func _init(world_seed):
+	overhang_noise = FastNoiseLite.new()
+	overhang_noise.seed = world_seed + 1
+	overhang_noise.frequency = 1.0 / 24
+	overhang_noise.fractal_octaves = 2
+	cave_noise = FastNoiseLite.new()
+	cave_noise.seed = world_seed + 2
+	cave_noise.frequency = 1.0 / 48
+	cave_noise.fractal_octaves = 2
+
+# Deepest anything but solid ground reaches under a column's height
+func reach():
+	return cave_depth + cave_width * cave_scale + overhang
+
+# Density block over width x width columns of column_heights (row major,
+# first column at origin) on a cubic lattice of spacing. Layer k is at
+# (bottom + k) * spacing, the two lowest layers are solid and the two
+# highest empty as SurfaceNetsBuilder wants. Safe on pool threads.
+func fill(column_heights, width, spacing, origin):
+	var low = INF
+	var high = -INF
+	for h in column_heights:
+		low = min(low, h)
+		high = max(high, h)
+	var below = reach()
+	var bottom = floori((low - below) / spacing) - 1
+	var layers = ceili((high + overhang) / spacing) + 1 - bottom + 1
+
+	var density = PackedFloat32Array()
+	density.resize(width * width * layers)
+	var v = 0
+	for k in range(layers):
+		var y = (bottom + k) * spacing
+		for j in range(width):
+			var sample_z = origin.y + j * spacing
+			for i in range(width):
+				var h = column_heights[j * width + i]
+				var depth = h - y
+				var d = depth
+				# Outside the band the noise cannot flip the sign, plain depth keeps it continuous enough
+				if depth > -overhang and depth < below:
+					var sample_x = origin.x + i * spacing
+					d += overhang_noise.get_noise_3d(sample_x, y, sample_z) * overhang
+					var tunnel = (abs(cave_noise.get_noise_3d(sample_x, y, sample_z)) - cave_width) * cave_scale
+					d = min(d, tunnel + max(0.0, depth - cave_depth))
+				density[v] = d
+				v += 1
+
+	return {"density": density, "layers": layers, "bottom": bottom}
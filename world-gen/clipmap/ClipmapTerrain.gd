@@ -0,0 +1,249 @@
+# ClipmapTerrain.gd
+extends Node3D
+class_name ClipmapTerrain
+
+# Far field terrain around the near field chunks, as a geometry clipmap:
+# levels nested square rings of ring_cells cells, each one twice as
+# coarse as the one inside it, all centred on set_center(). Level 0 leaves
+# a hole of ring_cells / 4 cells on each side for whatever draws the near
+# field (world.gd hides its chunks outside that hole), every further level a hole exactly the size of the level inside.
+# The triangle count is fixed however far the view goes.
+#
+# Every level keeps its heights in a toroidal float texture: lattice point
+# g of a level sits at g * spacing and lives at texel g mod texture_size,
+# so a move only samples the rows and columns that scrolled in. Sampling
+# runs on a pool thread, one update at a time; the main thread only
+# uploads the finished images. Lattice points coincide with the chunk
+# height grids, so the far field meets the near field at the same heights.
+#
+# With baked on, the pool thread also bakes each level into a plain mesh
+# from those heights (same vertices, border interpolation and normals as
+# the shader) drawn with the chunks' terrain material, and the main thread
+# swaps the meshes in. Still one draw call per level and no per frame
+# cost, but nothing reads textures in the vertex shader.
+
+# Number of rings, level l has a spacing of base_spacing * 2^l
+@export var levels = 3
+# Cells per side of a ring, a multiple of 4
+@export var ring_cells = 64
+@export var base_spacing = 32.0
+@export var baked = false
+
+const shader = preload("res://world-gen/clipmap/clipmap_terrain.gdshader")
+
+var noise
+var height_scale = 80.0
+# One mesh and index array per parity of the hole inside a ring, see ring_index_array()
+var ring_meshes = []
+var ring_indices = []
+var level_instances = []
+var level_materials = []
+var level_textures = []
+var level_heights = []
+# Lattice index of the first texel column and row of each level, null until sampled
+var level_windows = []
+var center
+var sampled_center
+var update_task = -1
+var update_result = []
+
+func texture_size():
+	# One spare sample on every side for the normals
+	return ring_cells + 3
+
+func _ready():
+	for parity in range(4):
+		ring_indices.append(ring_index_array(Vector2i(parity & 1, parity >> 1)))
+		ring_meshes.append(build_ring(ring_indices[parity]))
+
+	var size = texture_size()
+	for level in range(levels):
+		var heights = PackedFloat32Array()
+		heights.resize(size * size)
+		heights.fill(0.0)
+		level_heights.append(heights)
+		level_windows.append(null)
+		level_textures.append(ImageTexture.create_from_image(Image.create_from_data(size, size, false, Image.FORMAT_RF, heights.to_byte_array())))
+
+		var material = ShaderMaterial.new()
+		material.shader = shader
+		material.set_shader_parameter("heights", level_textures[level])
+		material.set_shader_parameter("spacing", base_spacing * (1 << level))
+		material.set_shader_parameter("ring_half", ring_cells / 2)
+		material.set_shader_parameter("texture_size", size)
+		level_materials.append(material)
+
+		var instance = MeshInstance3D.new()
+		instance.material_override = Chunk.terrain_material if baked else material
+		instance.cast_shadow = GeometryInstance3D.SHADOW_CASTING_SETTING_OFF
+		# Nothing is sampled yet
+		instance.visible = false
+		add_child(instance)
+		level_instances.append(instance)
+
+func _exit_tree():
+	if update_task >= 0:
+		WorkerThreadPool.wait_for_task_completion(update_task)
+		update_task = -1
+
+# World position the rings centre on, a multiple of base_spacing
+func set_center(world_center):
+	center = world_center
+
+func _process(delta):
+	if update_task >= 0:
+		if not WorkerThreadPool.is_task_completed(update_task):
+			return
+		WorkerThreadPool.wait_for_task_completion(update_task)
+		update_task = -1
+		apply_update()
+
+	if center != null and center != sampled_center:
+		sampled_center = center
+		update_task = WorkerThreadPool.add_task(sample_levels.bind(center), false, "clipmap update")
+
+# Flat ring in lattice units from -ring_cells / 2 to ring_cells / 2
+func build_ring(indices):
+	var half = ring_cells / 2
+	var side = ring_cells + 1
+	var vertices = PackedVector3Array()
+	vertices.resize(side * side)
+	var v = 0
+	for j in range(-half, half + 1):
+		for i in range(-half, half + 1):
+			vertices[v] = Vector3(i, 0, j)
+			v += 1
+
+	var arrays = []
+	arrays.resize(Mesh.ARRAY_MAX)
+	arrays[Mesh.ARRAY_VERTEX] = vertices
+	arrays[Mesh.ARRAY_INDEX] = indices
+	var mesh = ArrayMesh.new()
+	mesh.add_surface_from_arrays(Mesh.PRIMITIVE_TRIANGLES, arrays)
+	return mesh
+
+# Ring triangles over the (ring_cells + 1)^2 vertex grid, with the hole
+# shifted by parity: the level inside snaps to half this level's
+# spacing, so it sits either flush or one cell up on each axis
+func ring_index_array(parity):
+	var half = ring_cells / 2
+	var quarter = ring_cells / 4
+	var side = ring_cells + 1
+	var indices = PackedInt32Array()
+	for j in range(ring_cells):
+		for i in range(ring_cells):
+			var cell = Vector2i(i - half, j - half)
+			if cell.x >= parity.x - quarter and cell.x < parity.x + quarter \
+					and cell.y >= parity.y - quarter and cell.y < parity.y + quarter:
+				continue
+			var v00 = j * side + i
+			var v10 = v00 + 1
+			var v01 = v00 + side
+			var v11 = v01 + 1
+			# Clockwise seen from above, same as HeightfieldMeshBuilder
+			indices.append_array(PackedInt32Array([v00, v10, v01, v10, v11, v01]))
+	return indices
+
+# Runs on a pool thread, the level arrays are not read anywhere else while it does
+func sample_levels(world_center):
+	var result = []
+	var size = texture_size()
+	for level in range(levels):
+		var spacing = base_spacing * (1 << level)
+		# Centres snap to twice the spacing, so every border vertex of a
+		# coarser level lands on an even vertex of this one
+		var origin = Vector2i(floori(world_center.x / (2.0 * spacing)) * 2, floori(world_center.y / (2.0 * spacing)) * 2)
+		var inner = Vector2i(floori(world_center.x / spacing), floori(world_center.y / spacing))
+		var low = origin - Vector2i(ring_cells / 2 + 1, ring_cells / 2 + 1)
+		sample_window(level, low, spacing)
+		var update = {"origin": origin, "parity": inner - origin}
+		if baked:
+			update.arrays = bake_level(level, origin, update.parity, spacing)
+		else:
+			update.image = Image.create_from_data(size, size, false, Image.FORMAT_RF, level_heights[level].to_byte_array())
+		result.append(update)
+	update_result = result
+
+# Samples the part of the new window the old one did not cover
+func sample_window(level, low, spacing):
+	var size = texture_size()
+	var old_low = level_windows[level]
+	var heights = level_heights[level]
+	for j in range(size):
+		var gz = low.y + j
+		if old_low == null or gz < old_low.y or gz >= old_low.y + size:
+			heights = sample_run(heights, low.x, low.x + size, gz, spacing)
+			continue
+		# Row already there, only the columns that scrolled in are new
+		if low.x < old_low.x:
+			heights = sample_run(heights, low.x, min(old_low.x, low.x + size), gz, spacing)
+		if low.x + size > old_low.x + size:
+			heights = sample_run(heights, max(old_low.x + size, low.x), low.x + size, gz, spacing)
+	level_heights[level] = heights
+	level_windows[level] = low
+
+func sample_run(heights, from_x, to_x, gz, spacing):
+	var size = texture_size()
+	var row = posmod(gz, size) * size
+	var samples = HeightmapSampler.sample_rect(noise, from_x, gz, to_x - from_x, 1, spacing, 0.0, height_scale)
+	for s in range(samples.size()):
+		heights[row + posmod(from_x + s, size)] = samples[s]
+	return heights
+
+# What clipmap_terrain.gdshader does per vertex, on the pool thread
+func bake_level(level, origin, parity, spacing):
+	var heights = level_heights[level]
+	var half = ring_cells / 2
+	var side = ring_cells + 1
+	var vertices = PackedVector3Array()
+	var normals = PackedVector3Array()
+	vertices.resize(side * side)
+	normals.resize(side * side)
+	var v = 0
+	for j in range(-half, half + 1):
+		for i in range(-half, half + 1):
+			var g = origin + Vector2i(i, j)
+			var height = lattice_height(heights, g)
+			if abs(i) == half and (g.y & 1) == 1:
+				height = 0.5 * (lattice_height(heights, g - Vector2i(0, 1)) + lattice_height(heights, g + Vector2i(0, 1)))
+			elif abs(j) == half and (g.x & 1) == 1:
+				height = 0.5 * (lattice_height(heights, g - Vector2i(1, 0)) + lattice_height(heights, g + Vector2i(1, 0)))
+			var dx = lattice_height(heights, g + Vector2i(1, 0)) - lattice_height(heights, g - Vector2i(1, 0))
+			var dz = lattice_height(heights, g + Vector2i(0, 1)) - lattice_height(heights, g - Vector2i(0, 1))
+			vertices[v] = Vector3(g.x * spacing, height, g.y * spacing)
+			normals[v] = Vector3(-dx, 2.0 * spacing, -dz).normalized()
+			v += 1
+
+	var arrays = []
+	arrays.resize(Mesh.ARRAY_MAX)
+	arrays[Mesh.ARRAY_VERTEX] = vertices
+	arrays[Mesh.ARRAY_NORMAL] = normals
+	arrays[Mesh.ARRAY_INDEX] = ring_indices[parity.x + parity.y * 2]
+	return arrays
+
+func lattice_height(heights, g):
+	var size = texture_size()
+	return heights[posmod(g.y, size) * size + posmod(g.x, size)]
+
+func apply_update():
+	for level in range(levels):
+		var update = update_result[level]
+		var instance = level_instances[level]
+		if baked:
+			# Real geometry, so the engine works out the bounds itself
+			var mesh = ArrayMesh.new()
+			mesh.add_surface_from_arrays(Mesh.PRIMITIVE_TRIANGLES, update.arrays)
+			instance.mesh = mesh
+			instance.visible = true
+			continue
+
+		var spacing = base_spacing * (1 << level)
+		var extent = ring_cells / 2 * spacing
+		level_textures[level].update(update.image)
+		level_materials[level].set_shader_parameter("origin", update.origin)
+		instance.mesh = ring_meshes[update.parity.x + update.parity.y * 2]
+		# The mesh is in lattice units, the shader places it, so culling needs the real bounds
+		var middle = Vector3(update.origin.x * spacing, 0, update.origin.y * spacing)
+		instance.custom_aabb = AABB(middle - Vector3(extent, height_scale, extent), Vector3(extent * 2, height_scale * 2, extent * 2))
+		instance.visible = true
+	update_result = []
@@ -0,0 +1,45 @@
+# GpuGridSource.gd
+extends GridSource
+class_name GpuGridSource
+
+# GpuHeightmapSampler as a GridSource. One compute batch is in flight at
+# a time: collect() waits for the last one, and the cells submitted after
+# it go out as the next batch on flush().
+
+var sampler
+var batch = []
+var batch_usec = 0
+# ChunkProfiler from world.gd, null when not profiling
+var profiler
+
+func _init(sampler):
+	self.sampler = sampler
+
+func capacity():
+	return 0 if sampler.is_busy() else sampler.batch_size - batch.size()
+
+func submit(cell, priority):
+	super(cell, priority)
+	batch.append(cell)
+
+func flush():
+	if batch.is_empty():
+		return
+	batch_usec = Time.get_ticks_usec()
+	sampler.submit(batch)
+	batch = []
+
+func collect():
+	var result = {"grids": {}, "returned": []}
+	if not sampler.is_busy():
+		return result
+	var grids = sampler.collect()
+	if profiler != null:
+		profiler.since("gpu_batch", batch_usec)
+	for cell in grids:
+		if in_flight.erase(cell):
+			result.grids[cell] = grids[cell]
+	return result
+
+func close():
+	sampler.release()
@@ -0,0 +1,138 @@
+# GpuHeightmapSampler.gd
+extends RefCounted
+class_name GpuHeightmapSampler
+
+# Samples a batch of chunk height grids in one compute dispatch on a local
+# RenderingDevice, see heightmap.glsl. Grids come back in the same apron
+# padded layout HeightmapCache builds on the CPU, so normals, LODs and
+# collision keep coming from the grid as before. The shader only ports
+# the noise settings world.gd uses; for anything else, and without a
+# RenderingDevice (Compatibility renderer, headless), is_available() is
+# false and the CPU path stays in charge.
+#
+# A RenderingDevice is not thread safe, so world.gd drives this from the
+# main thread: submit() in one frame, collect() in a later one, so the
+# GPU works while the frame goes on.
+
+const shader_path = "res://world-gen/gpu/heightmap.glsl"
+
+var rd
+var shader = RID()
+var pipeline = RID()
+var bases_buffer = RID()
+var heights_buffer = RID()
+var uniform_set = RID()
+var heightmap_cache
+var batch_size
+var width
+var constants
+var octaves
+var seed
+var pending = []
+
+static func is_supported(noise):
+	return noise is FastNoiseLite and noise.noise_type == FastNoiseLite.TYPE_SIMPLEX_SMOOTH \
+		and (noise.fractal_type == FastNoiseLite.FRACTAL_NONE or noise.fractal_type == FastNoiseLite.FRACTAL_FBM) \
+		and not noise.domain_warp_enabled
+
+# Same first octave scale FastNoiseLite uses to keep FBm within -1..1
+static func fractal_bounding(octaves, gain):
+	var amp = abs(gain)
+	var amp_fractal = 1.0
+	for i in range(1, octaves):
+		amp_fractal += amp
+		amp *= abs(gain)
+	return 1.0 / amp_fractal
+
+func _init(heightmap_cache, batch_size):
+	self.heightmap_cache = heightmap_cache
+	self.batch_size = batch_size
+	width = heightmap_cache.grid_width()
+
+	var noise = heightmap_cache.noise
+	if not is_supported(noise):
+		return
+	rd = RenderingServer.create_local_rendering_device()
+	if rd == null:
+		return
+
+	var spirv = load(shader_path).get_spirv()
+	if spirv.compile_error_compute != "":
+		push_error(spirv.compile_error_compute)
+		rd.free()
+		rd = null
+		return
+	shader = rd.shader_create_from_spirv(spirv, "chunk heightmap")
+	pipeline = rd.compute_pipeline_create(shader)
+
+	bases_buffer = rd.storage_buffer_create(batch_size * 8)
+	heights_buffer = rd.storage_buffer_create(batch_size * width * width * 4)
+	var bases_uniform = RDUniform.new()
+	bases_uniform.uniform_type = RenderingDevice.UNIFORM_TYPE_STORAGE_BUFFER
+	bases_uniform.binding = 0
+	bases_uniform.add_id(bases_buffer)
+	var heights_uniform = RDUniform.new()
+	heights_uniform.uniform_type = RenderingDevice.UNIFORM_TYPE_STORAGE_BUFFER
+	heights_uniform.binding = 1
+	heights_uniform.add_id(heights_buffer)
+	uniform_set = rd.uniform_set_create([bases_uniform, heights_uniform], shader, 0)
+
+	# Float half of the push constant, the int half depends on the batch
+	seed = noise.seed
+	octaves = noise.fractal_octaves if noise.fractal_type == FastNoiseLite.FRACTAL_FBM else 0
+	constants = PackedFloat32Array([
+		noise.offset.x, noise.offset.y, noise.offset.z, heightmap_cache.spacing,
+		noise.frequency, noise.fractal_lacunarity, noise.fractal_gain, noise.fractal_weighted_strength,
+		fractal_bounding(noise.fractal_octaves, noise.fractal_gain), heightmap_cache.height_scale, -heightmap_cache.chunk_size * 0.5, 0.0,
+	]).to_byte_array()
+
+func is_available():
+	return rd != null
+
+func is_busy():
+	return not pending.is_empty()
+
+# Starts sampling up to batch_size cells, collect() hands the grids back
+func submit(cells):
+	var bases = PackedInt32Array()
+	for cell in cells:
+		bases.append(heightmap_cache.grid_base(cell.x))
+		bases.append(heightmap_cache.grid_base(cell.y))
+	rd.buffer_update(bases_buffer, 0, bases.size() * 4, bases.to_byte_array())
+
+	var push_constant = constants.duplicate()
+	push_constant.append_array(PackedInt32Array([seed, octaves, width, cells.size()]).to_byte_array())
+
+	var groups = ceili(width / 8.0)
+	var list = rd.compute_list_begin()
+	rd.compute_list_bind_compute_pipeline(list, pipeline)
+	rd.compute_list_bind_uniform_set(list, uniform_set, 0)
+	rd.compute_list_set_push_constant(list, push_constant, push_constant.size())
+	rd.compute_list_dispatch(list, groups, groups, cells.size())
+	rd.compute_list_end()
+	rd.submit()
+	pending = cells
+
+# Waits for the last submit() and returns its grids by cell
+func collect():
+	rd.sync()
+	var floats = width * width
+	var data = rd.buffer_get_data(heights_buffer, 0, pending.size() * floats * 4).to_float32_array()
+	var grids = {}
+	for n in range(pending.size()):
+		grids[pending[n]] = data.slice(n * floats, (n + 1) * floats)
+	pending = []
+	return grids
+
+func release():
+	if rd == null:
+		return
+	if is_busy():
+		collect()
+	rd.free_rid(uniform_set)
+	rd.free_rid(heights_buffer)
+	rd.free_rid(bases_buffer)
+	rd.free_rid(pipeline)
+	rd.free_rid(shader)
+	rd.free()
+	rd = null
@@ -0,0 +1,229 @@
+#[compute]
+#version 450
+
+// Fills chunk height grids (with their one sample apron) on the GPU. Port
+// of the parts of FastNoiseLite that world.gd's noise uses: OpenSimplex2S
+// 3D with the default OpenSimplex2 rotation, plain or FBm fractal. Same
+// lattice as HeightmapCache: sample g of a grid sits at
+// (base + g) * spacing + world_offset, at y = 0.
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+layout(set = 0, binding = 0, std430) restrict readonly buffer Bases {
+	ivec2 bases[];
+};
+
+layout(set = 0, binding = 1, std430) restrict writeonly buffer Heights {
+	float heights[];
+};
+
+layout(push_constant, std430) uniform Params {
+	vec4 offset_spacing; // noise offset xyz, sample spacing
+	vec4 fractal; // frequency, lacunarity, gain, weighted strength
+	vec4 scale; // fractal bounding, height scale, world offset, unused
+	ivec4 counts; // seed, octaves (0 = no fractal), grid width, grid count
+} params;
+
+const int PRIME_X = 501125321;
+const int PRIME_Y = 1136930381;
+const int PRIME_Z = 1720413743;
+
+// FastNoiseLite's Gradients3D: the 12 cube edges five times, then four extra
+const vec3 GRADIENTS[12] = vec3[12](
+	vec3(0, 1, 1), vec3(0, -1, 1), vec3(0, 1, -1), vec3(0, -1, -1),
+	vec3(1, 0, 1), vec3(-1, 0, 1), vec3(1, 0, -1), vec3(-1, 0, -1),
+	vec3(1, 1, 0), vec3(-1, 1, 0), vec3(1, -1, 0), vec3(-1, -1, 0));
+const vec3 GRADIENTS_TAIL[4] = vec3[4](
+	vec3(1, 1, 0), vec3(0, -1, 1), vec3(-1, 1, 0), vec3(0, -1, -1));
+
+// Not floor(): FastNoiseLite rounds exact negative integers one further down
+int fast_floor(float f) {
+	return f >= 0.0 ? int(f) : int(f) - 1;
+}
+
+float grad_coord(int seed, int x_primed, int y_primed, int z_primed, float xd, float yd, float zd) {
+	int hash = (seed ^ x_primed ^ y_primed ^ z_primed) * 0x27d4eb2d;
+	hash ^= hash >> 15;
+	int index = (hash & (63 << 2)) >> 2;
+	vec3 gradient = index < 60 ? GRADIENTS[index % 12] : GRADIENTS_TAIL[index - 60];
+	return xd * gradient.x + yd * gradient.y + zd * gradient.z;
+}
+
+float falloff(float a) {
+	return (a * a) * (a * a);
+}
+
+float open_simplex2s(int seed, float x, float y, float z) {
+	int i = fast_floor(x);
+	int j = fast_floor(y);
+	int k = fast_floor(z);
+	float xi = x - float(i);
+	float yi = y - float(j);
+	float zi = z - float(k);
+
+	i *= PRIME_X;
+	j *= PRIME_Y;
+	k *= PRIME_Z;
+	int seed2 = seed + 1293373;
+
+	int x_mask = int(-0.5 - xi);
+	int y_mask = int(-0.5 - yi);
+	int z_mask = int(-0.5 - zi);
+
+	float x0 = xi + float(x_mask);
+	float y0 = yi + float(y_mask);
+	float z0 = zi + float(z_mask);
+	float a0 = 0.75 - x0 * x0 - y0 * y0 - z0 * z0;
+	float value = falloff(a0) * grad_coord(seed,
+			i + (x_mask & PRIME_X), j + (y_mask & PRIME_Y), k + (z_mask & PRIME_Z), x0, y0, z0);
+
+	float x1 = xi - 0.5;
+	float y1 = yi - 0.5;
+	float z1 = zi - 0.5;
+	float a1 = 0.75 - x1 * x1 - y1 * y1 - z1 * z1;
+	value += falloff(a1) * grad_coord(seed2,
+			i + PRIME_X, j + PRIME_Y, k + PRIME_Z, x1, y1, z1);
+
+	float x_flip0 = float((x_mask | 1) << 1) * x1;
+	float y_flip0 = float((y_mask | 1) << 1) * y1;
+	float z_flip0 = float((z_mask | 1) << 1) * z1;
+	float x_flip1 = float(-2 - (x_mask << 2)) * x1 - 1.0;
+	float y_flip1 = float(-2 - (y_mask << 2)) * y1 - 1.0;
+	float z_flip1 = float(-2 - (z_mask << 2)) * z1 - 1.0;
+
+	bool skip5 = false;
+	float a2 = x_flip0 + a0;
+	if (a2 > 0.0) {
+		value += falloff(a2) * grad_coord(seed,
+				i + (~x_mask & PRIME_X), j + (y_mask & PRIME_Y), k + (z_mask & PRIME_Z),
+				x0 - float(x_mask | 1), y0, z0);
+	} else {
+		float a3 = y_flip0 + z_flip0 + a0;
+		if (a3 > 0.0) {
+			value += falloff(a3) * grad_coord(seed,
+					i + (x_mask & PRIME_X), j + (~y_mask & PRIME_Y), k + (~z_mask & PRIME_Z),
+					x0, y0 - float(y_mask | 1), z0 - float(z_mask | 1));
+		}
+
+		float a4 = x_flip1 + a1;
+		if (a4 > 0.0) {
+			value += falloff(a4) * grad_coord(seed2,
+					i + (x_mask & (PRIME_X * 2)), j + PRIME_Y, k + PRIME_Z,
+					float(x_mask | 1) + x1, y1, z1);
+			skip5 = true;
+		}
+	}
+
+	bool skip9 = false;
+	float a6 = y_flip0 + a0;
+	if (a6 > 0.0) {
+		value += falloff(a6) * grad_coord(seed,
+				i + (x_mask & PRIME_X), j + (~y_mask & PRIME_Y), k + (z_mask & PRIME_Z),
+				x0, y0 - float(y_mask | 1), z0);
+	} else {
+		float a7 = x_flip0 + z_flip0 + a0;
+		if (a7 > 0.0) {
+			value += falloff(a7) * grad_coord(seed,
+					i + (~x_mask & PRIME_X), j + (y_mask & PRIME_Y), k + (~z_mask & PRIME_Z),
+					x0 - float(x_mask | 1), y0, z0 - float(z_mask | 1));
+		}
+
+		float a8 = y_flip1 + a1;
+		if (a8 > 0.0) {
+			value += falloff(a8) * grad_coord(seed2,
+					i + PRIME_X, j + (y_mask & (PRIME_Y << 1)), k + PRIME_Z,
+					x1, float(y_mask | 1) + y1, z1);
+			skip9 = true;
+		}
+	}
+
+	bool skip_d = false;
+	float a_a = z_flip0 + a0;
+	if (a_a > 0.0) {
+		value += falloff(a_a) * grad_coord(seed,
+				i + (x_mask & PRIME_X), j + (y_mask & PRIME_Y), k + (~z_mask & PRIME_Z),
+				x0, y0, z0 - float(z_mask | 1));
+	} else {
+		float a_b = x_flip0 + y_flip0 + a0;
+		if (a_b > 0.0) {
+			value += falloff(a_b) * grad_coord(seed,
+					i + (~x_mask & PRIME_X), j + (~y_mask & PRIME_Y), k + (z_mask & PRIME_Z),
+					x0 - float(x_mask | 1), y0 - float(y_mask | 1), z0);
+		}
+
+		float a_c = z_flip1 + a1;
+		if (a_c > 0.0) {
+			value += falloff(a_c) * grad_coord(seed2,
+					i + PRIME_X, j + PRIME_Y, k + (z_mask & (PRIME_Z << 1)),
+					x1, y1, float(z_mask | 1) + z1);
+			skip_d = true;
+		}
+	}
+
+	if (!skip5) {
+		float a5 = y_flip1 + z_flip1 + a1;
+		if (a5 > 0.0) {
+			value += falloff(a5) * grad_coord(seed2,
+					i + PRIME_X, j + (y_mask & (PRIME_Y << 1)), k + (z_mask & (PRIME_Z << 1)),
+					x1, float(y_mask | 1) + y1, float(z_mask | 1) + z1);
+		}
+	}
+
+	if (!skip9) {
+		float a9 = x_flip1 + z_flip1 + a1;
+		if (a9 > 0.0) {
+			value += falloff(a9) * grad_coord(seed2,
+					i + (x_mask & (PRIME_X * 2)), j + PRIME_Y, k + (z_mask & (PRIME_Z << 1)),
+					float(x_mask | 1) + x1, y1, float(z_mask | 1) + z1);
+		}
+	}
+
+	if (!skip_d) {
+		float a_d = x_flip1 + y_flip1 + a1;
+		if (a_d > 0.0) {
+			value += falloff(a_d) * grad_coord(seed2,
+					i + (x_mask & (PRIME_X << 1)), j + (y_mask & (PRIME_Y << 1)), k + PRIME_Z,
+					float(x_mask | 1) + x1, float(y_mask | 1) + y1, z1);
+		}
+	}
+
+	return value * 9.046026385208288;
+}
+
+float get_noise(vec3 p) {
+	p *= params.fractal.x;
+	// DefaultOpenSimplex2 transform, a rotation rather than a skew
+	float r = (p.x + p.y + p.z) * (2.0 / 3.0);
+	p = vec3(r) - p;
+
+	int seed = params.counts.x;
+	if (params.counts.y <= 0) {
+		return open_simplex2s(seed, p.x, p.y, p.z);
+	}
+
+	float sum = 0.0;
+	float amp = params.scale.x;
+	for (int octave = 0; octave < params.counts.y; octave++) {
+		float n = open_simplex2s(seed++, p.x, p.y, p.z);
+		sum += n * amp;
+		amp *= mix(1.0, min(n + 1.0, 2.0) * 0.5, params.fractal.w);
+		p *= params.fractal.y;
+		amp *= params.fractal.z;
+	}
+	return sum;
+}
+
+void main() {
+	int width = params.counts.z;
+	uint grid = gl_GlobalInvocationID.z;
+	ivec2 g = ivec2(gl_GlobalInvocationID.xy);
+	if (g.x >= width || g.y >= width || grid >= uint(params.counts.w)) {
+		return;
+	}
+
+	ivec2 lattice = bases[grid] + g;
+	float spacing = params.offset_spacing.w;
+	float world_offset = params.scale.z;
+	vec3 p = vec3(float(lattice.x) * spacing + world_offset, 0.0, float(lattice.y) * spacing + world_offset);
+	heights[grid * uint(width * width) + uint(g.y * width + g.x)] = get_noise(p + params.offset_spacing.xyz) * params.scale.y;
+}
@@ -0,0 +1,238 @@
+# ChunkService.gd
+extends RefCounted
+class_name ChunkService
+
+# Serves chunk height grids over ENet, so every client of a shared world
+# gets the same terrain while the samples are computed once, on the
+# server. Clients ask for the cells they want with a priority (lower
+# first, as in ChunkRequestQueue) and cancel the ones that left their view;
+# a client never asks twice for a cell it already has. Each client has its
+# own queue of ready grids, and every poll() sends each client its most
+# urgent ones within send_budget_bytes.
+#
+# Missing grids are sampled on the WorkerThreadPool in the order of the
+# most urgent request for them, then kept zstd compressed for the next
+# client, max_cached of them, oldest dropped first. The float grids stay
+# in heightmap_cache as long as their compressed copy, so new grids keep
+# copying their borders from neighbours.
+#
+# Packets, all reliable:
+#   hello    server -> client  u8 HELLO, u32 version, string params hash, u32 grid width
+#   request  client -> server  u8 REQUEST, u32 count, count * (i32 x, i32 z, float priority)
+#   cancel   client -> server  u8 CANCEL, u32 count, count * (i32 x, i32 z)
+#   grid     server -> client  u8 GRID, i32 x, i32 z, u32 raw bytes, zstd float32 grid
+
+enum {HELLO, REQUEST, CANCEL, GRID}
+
+const version = 1
+const control_channel = 0
+const grid_channel = 1
+const channel_count = 2
+
+var heightmap_cache
+var params_hash
+var host
+var send_budget_bytes = 64 * 1024
+# Clients going past either limit are disconnected, world.gd stays far below
+var max_packet_entries = 1024
+var max_client_cells = 4096
+var max_cached = 4096
+var max_jobs = max(1, OS.get_processor_count() - 1)
+
+# ENetPacketPeer -> {"ready": ChunkRequestQueue, "waiting": {cell: priority}}
+var clients = {}
+# cell -> [raw bytes, compressed grid]
+var compressed = {}
+# Cells in the order they were compressed, from compressed_head on
+var compressed_order = []
+var compressed_head = 0
+var generate_queue = ChunkRequestQueue.new()
+# cell -> WorkerThreadPool task id
+var jobs = {}
+var finished = {}
+var finished_mutex = Mutex.new()
+var grids_sent = 0
+
+func _init(heightmap_cache, params_hash, port, max_clients = 32):
+	self.heightmap_cache = heightmap_cache
+	self.params_hash = params_hash
+	host = ENetConnection.new()
+	var error = host.create_host_bound("*", port, max_clients, channel_count)
+	if error != OK:
+		push_error("Chunk service cannot listen on port %d: %s" % [port, error_string(error)])
+		host = null
+
+func is_listening():
+	return host != null
+
+func get_client_count():
+	return clients.size()
+
+# Call once per frame from the main thread
+func poll():
+	if host == null:
+		return
+
+	while true:
+		var event = host.service()
+		var type = event[0]
+		if type == ENetConnection.EVENT_NONE or type == ENetConnection.EVENT_ERROR:
+			break
+		var peer = event[1]
+		if type == ENetConnection.EVENT_CONNECT:
+			clients[peer] = {"ready": ChunkRequestQueue.new(), "waiting": {}}
+			send_hello(peer)
+		elif type == ENetConnection.EVENT_DISCONNECT:
+			forget_client(peer)
+		elif type == ENetConnection.EVENT_RECEIVE:
+			receive(peer, peer.get_packet())
+
+	collect_jobs()
+	dispatch_jobs()
+	for peer in clients:
+		send_grids(peer)
+	host.flush()
+
+func send_hello(peer):
+	var buffer = StreamPeerBuffer.new()
+	buffer.put_u8(HELLO)
+	buffer.put_u32(version)
+	buffer.put_string(params_hash)
+	buffer.put_u32(heightmap_cache.grid_width())
+	peer.send(control_channel, buffer.data_array, ENetPacketPeer.FLAG_RELIABLE)
+
+func receive(peer, packet):
+	var client = clients.get(peer)
+	if client == null or packet.is_empty():
+		return
+	var buffer = StreamPeerBuffer.new()
+	buffer.data_array = packet
+	var type = buffer.get_u8()
+	var entry_bytes = 12 if type == REQUEST else 8
+	var count = buffer.get_u32()
+	# Malformed packets are dropped whole
+	if (type != REQUEST and type != CANCEL) or buffer.get_available_bytes() < count * entry_bytes:
+		return
+	if count > max_packet_entries:
+		drop_client(peer, "%d cells in one packet" % count)
+		return
+
+	for n in range(count):
+		var cell = Vector2i(buffer.get_32(), buffer.get_32())
+		if type == CANCEL:
+			client.ready.cancel(cell)
+			if client.waiting.erase(cell) and not is_waited_for(cell):
+				generate_queue.cancel(cell)
+			continue
+
+		var priority = buffer.get_float()
+		if compressed.has(cell):
+			client.ready.push(cell, priority)
+		else:
+			client.waiting[cell] = priority
+			want_generated(cell, priority)
+
+	if client.ready.size() + client.waiting.size() > max_client_cells:
+		drop_client(peer, "more than %d cells outstanding" % max_client_cells)
+
+func drop_client(peer, reason):
+	push_warning("Chunk service: dropping a client, %s" % reason)
+	forget_client(peer)
+	peer.peer_disconnect_now()
+
+# Also drops queued sampling nobody else waits for
+func forget_client(peer):
+	var client = clients.get(peer)
+	if client == null:
+		return
+	clients.erase(peer)
+	for cell in client.waiting:
+		if not is_waited_for(cell):
+			generate_queue.cancel(cell)
+
+func want_generated(cell, priority):
+	if jobs.has(cell):
+		return
+	if not generate_queue.has(cell) or priority < generate_queue.queued[cell]:
+		generate_queue.push(cell, priority)
+
+func dispatch_jobs():
+	while jobs.size() < max_jobs and not generate_queue.is_empty():
+		var cell = generate_queue.pop()
+		if compressed.has(cell) or not is_waited_for(cell):
+			continue
+		jobs[cell] = WorkerThreadPool.add_task(generate.bind(cell), false, "chunk service grid")
+
+func is_waited_for(cell):
+	for peer in clients:
+		if clients[peer].waiting.has(cell):
+			return true
+	return false
+
+# Pool thread
+func generate(cell):
+	var raw = heightmap_cache.get_or_build(cell).to_byte_array()
+	var packed = raw.compress(FileAccess.COMPRESSION_ZSTD)
+	finished_mutex.lock()
+	finished[cell] = [raw.size(), packed]
+	finished_mutex.unlock()
+
+func collect_jobs():
+	finished_mutex.lock()
+	var done = finished
+	finished = {}
+	finished_mutex.unlock()
+
+	for cell in done:
+		WorkerThreadPool.wait_for_task_completion(jobs[cell])
+		jobs.erase(cell)
+		compressed[cell] = done[cell]
+		compressed_order.append(cell)
+		for peer in clients:
+			var client = clients[peer]
+			if client.waiting.has(cell):
+				client.ready.push(cell, client.waiting[cell])
+				client.waiting.erase(cell)
+
+	while compressed.size() > max_cached:
+		var oldest = compressed_order[compressed_head]
+		compressed_head += 1
+		compressed.erase(oldest)
+		heightmap_cache.erase(oldest)
+	if compressed_head > 1024 and compressed_head * 2 > compressed_order.size():
+		compressed_order = compressed_order.slice(compressed_head)
+		compressed_head = 0
+
+func send_grids(peer):
+	var client = clients[peer]
+	var budget = send_budget_bytes
+	while budget > 0 and not client.ready.is_empty():
+		var cell = client.ready.pop()
+		var entry = compressed.get(cell)
+		if entry == null:
+			# Dropped from the cache before its turn came
+			client.waiting[cell] = 0.0
+			want_generated(cell, 0.0)
+			continue
+
+		var buffer = StreamPeerBuffer.new()
+		buffer.put_u8(GRID)
+		buffer.put_32(cell.x)
+		buffer.put_32(cell.y)
+		buffer.put_u32(entry[0])
+		buffer.put_data(entry[1])
+		peer.send(grid_channel, buffer.data_array, ENetPacketPeer.FLAG_RELIABLE)
+		budget -= buffer.get_size()
+		grids_sent += 1
+
+func close():
+	for cell in jobs:
+		WorkerThreadPool.wait_for_task_completion(jobs[cell])
+	jobs.clear()
+	if host != null:
+		for peer in clients:
+			peer.peer_disconnect()
+		host.flush()
+		host.destroy()
+		host = null
+	clients.clear()
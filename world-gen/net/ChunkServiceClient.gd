@@ -0,0 +1,150 @@
+# ChunkServiceClient.gd
+extends RefCounted
+class_name ChunkServiceClient
+
+# world.gd's end of a ChunkService connection. Only usable once the
+# server's hello has shown the same protocol version, terrain params hash
+# and grid width; a mismatch, no answer within connect_timeout seconds or
+# a dropped connection puts it into the failed state for good, and
+# world.gd goes back to generating everything locally.
+#
+# request() and cancel() are batched into one packet each per poll().
+# Ready grids pile up until take_grids(). Main thread only.
+
+enum {CONNECTING, READY, FAILED}
+
+var host
+var server
+var state = CONNECTING
+var params_hash
+var grid_width
+var connect_deadline
+var pending_requests = {}
+var pending_cancels = {}
+var received = {}
+
+func _init(address, port, params_hash, grid_width, connect_timeout = 5.0):
+	self.params_hash = params_hash
+	self.grid_width = grid_width
+	connect_deadline = Time.get_ticks_msec() + int(connect_timeout * 1000.0)
+	host = ENetConnection.new()
+	if host.create_host(1, ChunkService.channel_count) != OK:
+		fail("cannot create an ENet host")
+		return
+	server = host.connect_to_host(address, port, ChunkService.channel_count)
+	if server == null:
+		fail("cannot connect to %s:%d" % [address, port])
+
+func is_ready():
+	return state == READY
+
+func is_failed():
+	return state == FAILED
+
+func request(cell, priority):
+	pending_cancels.erase(cell)
+	pending_requests[cell] = priority
+
+# Always sent: an earlier request for the cell may already be out, and the
+# service ignores cancels for cells it never heard of
+func cancel(cell):
+	pending_requests.erase(cell)
+	pending_cancels[cell] = true
+
+# Grids received since the last call, cell -> PackedFloat32Array
+func take_grids():
+	var grids = received
+	received = {}
+	return grids
+
+func poll():
+	if state == FAILED:
+		return
+
+	while true:
+		var event = host.service()
+		var type = event[0]
+		if type == ENetConnection.EVENT_NONE:
+			break
+		if type == ENetConnection.EVENT_ERROR:
+			fail("ENet error")
+			return
+		if type == ENetConnection.EVENT_DISCONNECT:
+			fail("server disconnected")
+			return
+		if type == ENetConnection.EVENT_RECEIVE:
+			receive(event[1].get_packet())
+			if state == FAILED:
+				return
+
+	if state == CONNECTING:
+		if Time.get_ticks_msec() > connect_deadline:
+			fail("no answer from the server")
+		return
+
+	if not pending_requests.is_empty():
+		var buffer = StreamPeerBuffer.new()
+		buffer.put_u8(ChunkService.REQUEST)
+		buffer.put_u32(pending_requests.size())
+		for cell in pending_requests:
+			buffer.put_32(cell.x)
+			buffer.put_32(cell.y)
+			buffer.put_float(pending_requests[cell])
+		server.send(ChunkService.control_channel, buffer.data_array, ENetPacketPeer.FLAG_RELIABLE)
+		pending_requests.clear()
+
+	if not pending_cancels.is_empty():
+		var buffer = StreamPeerBuffer.new()
+		buffer.put_u8(ChunkService.CANCEL)
+		buffer.put_u32(pending_cancels.size())
+		for cell in pending_cancels:
+			buffer.put_32(cell.x)
+			buffer.put_32(cell.y)
+		server.send(ChunkService.control_channel, buffer.data_array, ENetPacketPeer.FLAG_RELIABLE)
+		pending_cancels.clear()
+
+	host.flush()
+
+func receive(packet):
+	if packet.is_empty():
+		return
+	var buffer = StreamPeerBuffer.new()
+	buffer.data_array = packet
+	var type = buffer.get_u8()
+
+	if type == ChunkService.HELLO:
+		var server_version = buffer.get_u32()
+		var server_hash = buffer.get_string()
+		var server_width = buffer.get_u32()
+		if server_version != ChunkService.version:
+			fail("protocol version %d, expected %d" % [server_version, ChunkService.version])
+		elif server_hash != params_hash or server_width != grid_width:
+			fail("the server runs a different seed or terrain settings")
+		else:
+			state = READY
+		return
+
+	if type != ChunkService.GRID or state != READY:
+		return
+	var cell = Vector2i(buffer.get_32(), buffer.get_32())
+	var raw_bytes = buffer.get_u32()
+	if raw_bytes != grid_width * grid_width * 4:
+		return
+	var raw = buffer.get_data(buffer.get_available_bytes())[1].decompress(raw_bytes, FileAccess.COMPRESSION_ZSTD)
+	if raw.size() == raw_bytes:
+		received[cell] = raw.to_float32_array()
+
+func fail(reason):
+	if state != FAILED:
+		push_warning("Chunk service: %s, generating chunks locally" % reason)
+	state = FAILED
+	close()
+
+func close():
+	if host == null:
+		return
+	if server != null and server.get_state() == ENetPacketPeer.STATE_CONNECTED:
+		server.peer_disconnect_now()
+	host.destroy()
+	host = null
+	server = null
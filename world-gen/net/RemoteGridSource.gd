@@ -0,0 +1,66 @@
+# RemoteGridSource.gd
+extends GridSource
+class_name RemoteGridSource
+
+# A ChunkService, through a ChunkServiceClient, as a GridSource. At most
+# max_in_flight cells are out at once; a cell still out after timeout
+# seconds is cancelled and comes back for local sampling, and so does
+# everything in flight once the connection fails.
+
+var client
+var max_in_flight
+var timeout_msec
+
+func _init(client, max_in_flight, timeout):
+	self.client = client
+	self.max_in_flight = max_in_flight
+	timeout_msec = int(timeout * 1000.0)
+
+func is_ready():
+	return client.is_ready()
+
+func is_failed():
+	return client.is_failed()
+
+func capacity():
+	return max_in_flight - in_flight.size()
+
+# in_flight holds the request time
+func submit(cell, priority):
+	in_flight[cell] = Time.get_ticks_msec()
+	client.request(cell, priority)
+
+# The service moves a repeated request to its new priority
+func reprioritise(cell, priority):
+	client.request(cell, priority)
+
+func cancel(cell):
+	if in_flight.erase(cell):
+		client.cancel(cell)
+
+# Sends this frame's requests right away instead of with the next poll
+func flush():
+	client.poll()
+
+func collect():
+	client.poll()
+	var result = {"grids": {}, "returned": []}
+	var grids = client.take_grids()
+	for cell in grids:
+		if in_flight.erase(cell):
+			result.grids[cell] = grids[cell]
+
+	if client.is_failed():
+		result.returned = in_flight.keys()
+		in_flight.clear()
+		return result
+
+	var now = Time.get_ticks_msec()
+	for cell in in_flight.keys():
+		if now - in_flight[cell] > timeout_msec:
+			cancel(cell)
+			result.returned.append(cell)
+	return result
+
+func close():
+	client.close()
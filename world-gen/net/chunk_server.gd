@@ -0,0 +1,52 @@
+# chunk_server.gd
+extends SceneTree
+
+# Dedicated ChunkService without a world of its own:
+#   godot --headless --script res://world-gen/net/chunk_server.gd -- --seed=N [--port=N] [--graph=res://...tres] [--disk-cache]
+#
+# Clients set randomize_seed off, the same world_seed and noise_graph, and
+# chunk_server_address / chunk_server_port in world.gd.
+
+const world_script = preload("res://world-gen/world.gd")
+const chunk_size = world_script.chunk_size
+
+var service
+
+func _initialize():
+	var noise_seed = 0
+	var port = 24550
+	var graph_path = ""
+	var disk_cache = false
+	for arg in OS.get_cmdline_user_args():
+		if arg.begins_with("--seed="):
+			noise_seed = int(arg.trim_prefix("--seed="))
+		elif arg.begins_with("--port="):
+			port = int(arg.trim_prefix("--port="))
+		elif arg.begins_with("--graph="):
+			graph_path = arg.trim_prefix("--graph=")
+		elif arg == "--disk-cache":
+			disk_cache = true
+
+	var noise = world_script.make_noise(noise_seed)
+	if graph_path != "":
+		noise = load(graph_path).duplicate()
+		noise.prepare(noise_seed)
+
+	var resolution = Chunk.grid_resolution(chunk_size)
+	var cache = HeightmapCache.new(noise, chunk_size, resolution, Chunk.height_scale)
+	if disk_cache:
+		cache.disk_cache = ChunkDiskCache.new(noise, chunk_size, resolution, Chunk.height_scale)
+	service = ChunkService.new(cache, ChunkDiskCache.params_hash(noise, chunk_size, resolution, Chunk.height_scale), port)
+	if not service.is_listening():
+		quit(1)
+		return
+	print("Chunk service on port %d, seed %d" % [port, noise_seed])
+
+func _process(_delta):
+	if service != null:
+		service.poll()
+	return false
+
+func _finalize():
+	if service != null:
+		service.close()
@@ -0,0 +1,205 @@
+# NoiseGraph.gd
+extends Resource
+class_name NoiseGraph
+
+# Terrain height as a small graph of noise nodes instead of one
+# FastNoiseLite, evaluated for a whole grid at a time: each node fills a
+# packed array for every requested sample before the next node reads it,
+# and a node read by several others runs once per grid. Nodes only read
+# earlier ones; the last node is the height, scaled by height_scale like
+# a plain noise value. Keep it within -1..1 as well: chunk culling and the
+# clipmap bounds assume heights within +-height_scale. seabed_graph.tres
+# sums to -2.6..1.6 and scales that by 1 / 2.6 at the end.
+#
+#   SOURCE    noise(x, 0, z) * value, what HeightmapSampler samples too
+#   CONSTANT  value everywhere
+#   ADD, MUL  sum or product of all inputs
+#   WARP      first input read at positions pushed by noise * value, x
+#             by noise(x, 0, z) and z by noise(x, warp_slice, z)
+#   CURVE     first input through curve, -1..1 onto its 0..1 domain
+#
+# A node with coarse_spacing > 0 is only evaluated on a world space
+# lattice of that spacing and bilinearly interpolated in between. Lattice
+# values are cached per region of region_cells x region_cells, so a low
+# frequency input such as a biome mask costs a few samples per region,
+# shared by every grid that overlaps it. The lattice is in world units,
+# so chunks, clipmap levels and neighbours all get the same value for
+# the same point.
+#
+# The exported resource is a template: world.gd duplicates it and calls
+# prepare() with the world seed on the main thread, after which sampling
+# is safe on pool threads.
+
+const region_cells = 16
+const max_regions = 1024
+# Second noise slice for WARP's z offset, far enough to be uncorrelated
+const warp_slice = 1000.0
+
+@export var nodes = []
+
+# Seeded copy of every node's noise, null for nodes without one
+var sources = []
+# Vector3i(node, region x, region z) -> lattice values, row major
+var regions = {}
+var mutex = Mutex.new()
+
+func prepare(world_seed):
+	sources.clear()
+	regions.clear()
+	for node in nodes:
+		var source = null
+		if node.noise != null:
+			source = node.noise.duplicate()
+			source.seed = world_seed + node.seed_offset
+		sources.append(source)
+		# Baked here, sample_baked() would otherwise bake on whichever pool thread gets there first
+		if node.curve != null:
+			node.curve.bake()
+
+# Same lattice and layout as HeightmapSampler.sample_rect()
+func sample_rect(index_x, index_z, width, depth, spacing, offset, height_scale):
+	var xs = PackedFloat64Array()
+	var zs = PackedFloat64Array()
+	xs.resize(width * depth)
+	zs.resize(width * depth)
+	var v = 0
+	for j in range(depth):
+		var sample_z = (index_z + j) * spacing + offset
+		for i in range(width):
+			xs[v] = (index_x + i) * spacing + offset
+			zs[v] = sample_z
+			v += 1
+
+	var heights = evaluate(nodes.size() - 1, xs, zs, {})
+	for i in range(heights.size()):
+		heights[i] *= height_scale
+	return heights
+
+# memo holds the node results for these positions, so shared inputs run once
+func evaluate(index, xs, zs, memo):
+	if memo.has(index):
+		return memo[index]
+	var values
+	if nodes[index].coarse_spacing > 0.0:
+		values = sample_coarse(index, xs, zs)
+	else:
+		values = evaluate_node(index, xs, zs, memo)
+	memo[index] = values
+	return values
+
+func evaluate_node(index, xs, zs, memo):
+	var node = nodes[index]
+	var count = xs.size()
+	var values = PackedFloat32Array()
+	values.resize(count)
+	match node.kind:
+		NoiseGraphNode.SOURCE:
+			var source = sources[index]
+			for i in range(count):
+				values[i] = source.get_noise_3d(xs[i], 0.0, zs[i]) * node.value
+		NoiseGraphNode.CONSTANT:
+			values.fill(node.value)
+		NoiseGraphNode.ADD:
+			values.fill(0.0)
+			for input in node.inputs:
+				var input_values = evaluate(input, xs, zs, memo)
+				for i in range(count):
+					values[i] += input_values[i]
+		NoiseGraphNode.MUL:
+			values.fill(1.0)
+			for input in node.inputs:
+				var input_values = evaluate(input, xs, zs, memo)
+				for i in range(count):
+					values[i] *= input_values[i]
+		NoiseGraphNode.WARP:
+			var source = sources[index]
+			var warped_x = PackedFloat64Array()
+			var warped_z = PackedFloat64Array()
+			warped_x.resize(count)
+			warped_z.resize(count)
+			for i in range(count):
+				warped_x[i] = xs[i] + source.get_noise_3d(xs[i], 0.0, zs[i]) * node.value
+				warped_z[i] = zs[i] + source.get_noise_3d(xs[i], warp_slice, zs[i]) * node.value
+			# Other positions, so nothing from the caller's memo applies
+			values = evaluate(node.inputs[0], warped_x, warped_z, {})
+		NoiseGraphNode.CURVE:
+			var input_values = evaluate(node.inputs[0], xs, zs, memo)
+			for i in range(count):
+				values[i] = node.curve.sample_baked(clampf(input_values[i] * 0.5 + 0.5, 0.0, 1.0))
+	return values
+
+# Bilinear over the node's cached lattice
+func sample_coarse(index, xs, zs):
+	var spacing = nodes[index].coarse_spacing
+	var side = region_cells + 1
+	var count = xs.size()
+	var values = PackedFloat32Array()
+	values.resize(count)
+	var region = null
+	var lattice
+	for i in range(count):
+		var gx = xs[i] / spacing
+		var gz = zs[i] / spacing
+		var cx = floori(gx)
+		var cz = floori(gz)
+		var key = Vector2i(floori(cx / float(region_cells)), floori(cz / float(region_cells)))
+		# Grids are row major, so neighbouring samples nearly always share the region
+		if key != region:
+			region = key
+			lattice = coarse_region(index, key)
+		var row = (cz - key.y * region_cells) * side + cx - key.x * region_cells
+		var top = lerpf(lattice[row], lattice[row + 1], gx - cx)
+		var bottom = lerpf(lattice[row + side], lattice[row + side + 1], gx - cx)
+		values[i] = lerpf(top, bottom, gz - cz)
+	return values
+
+func coarse_region(index, region):
+	var cache_key = Vector3i(index, region.x, region.y)
+	mutex.lock()
+	var lattice = regions.get(cache_key)
+	mutex.unlock()
+	if lattice != null:
+		return lattice
+
+	# Two threads may both miss and sample the same region, they get the same values
+	var spacing = nodes[index].coarse_spacing
+	var side = region_cells + 1
+	var xs = PackedFloat64Array()
+	var zs = PackedFloat64Array()
+	xs.resize(side * side)
+	zs.resize(side * side)
+	var v = 0
+	for j in range(side):
+		for i in range(side):
+			xs[v] = (region.x * region_cells + i) * spacing
+			zs[v] = (region.y * region_cells + j) * spacing
+			v += 1
+	lattice = evaluate_node(index, xs, zs, {})
+
+	mutex.lock()
+	if regions.size() >= max_regions:
+		# Oldest first, dictionaries keep insertion order
+		for old in regions:
+			regions.erase(old)
+			break
+	regions[cache_key] = lattice
+	mutex.unlock()
+	return lattice
+
+# Everything the heights depend on, for ChunkDiskCache's directory hash
+func get_cache_params():
+	var params = []
+	for index in range(nodes.size()):
+		var node = nodes[index]
+		params.append([node.kind, node.inputs, node.value, node.coarse_spacing])
+		var source = sources[index]
+		if source != null:
+			params.append([source.seed, source.noise_type, source.frequency, source.offset,
+				source.fractal_type, source.fractal_octaves, source.fractal_lacunarity, source.fractal_gain,
+				source.fractal_weighted_strength, source.fractal_ping_pong_strength])
+		if node.curve != null:
+			var points = []
+			for p in range(node.curve.point_count):
+				points.append([node.curve.get_point_position(p), node.curve.get_point_left_tangent(p), node.curve.get_point_right_tangent(p)])
+			params.append([node.curve.min_value, node.curve.max_value, points])
+	return params
@@ -0,0 +1,20 @@
+# NoiseGraphNode.gd
+extends Resource
+class_name NoiseGraphNode
+
+# One node of a NoiseGraph, see there for what each kind computes
+
+enum {SOURCE, CONSTANT, ADD, MUL, WARP, CURVE}
+
+@export_enum("Source", "Constant", "Add", "Mul", "Warp", "Curve") var kind = SOURCE
+# Indices of the nodes this one reads, all earlier in the graph
+@export var inputs = PackedInt32Array()
+# Sampled by SOURCE, pushes the positions of WARP's input
+@export var noise: FastNoiseLite
+# Added to the world seed, so sources sharing settings still differ
+@export var seed_offset = 0
+# Scale of SOURCE and WARP noise, the CONSTANT itself
+@export var value = 1.0
+@export var curve: Curve
+# World units between cached lattice samples, 0 = evaluated at every sample
+@export var coarse_spacing = 0.0
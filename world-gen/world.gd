@@ -3,71 +3,1049 @@ extends Node3D
 
 const chunk_size = 64
 const chunk_amount = 16
+# Cells per side of the blocks the frustum test checks before single chunks
+const cull_block = 4
+enum {OUTSIDE, CROSSING, INSIDE}
+
+# Pre-warm went through another done of total chunks
+signal prewarm_progress(done, total)
+# The first view is in place, msec since _ready
+signal startup_finished(msec)
+# The view square moved: cells that came into it and cells that left it, Arrays of Vector2i
+signal strip_entered(cells)
+signal strip_evicted(cells)
+
+# Pick a new seed every run, off means world_seed is used as is
+@export var randomize_seed = true
+@export var world_seed = 0
+# Terrain height from a NoiseGraph (e.g. res://world-gen/noise/seabed_graph.tres) instead of make_noise()
+@export var noise_graph: NoiseGraph
+# Build the inner N rings around the player on all cores before the world is shown
+@export var prewarm_rings = 0
+# Chunk jobs allowed on the WorkerThreadPool at once, 0 = one per spare core
+@export var max_chunk_jobs = 0
+# How much extra distance a chunk behind the camera pays, 0 = distance only
+@export var heading_weight = 1.0
+# Extra distance a chunk outside the camera frustum pays, and how many LODs coarser it is built
+@export var offscreen_penalty = 4.0
+@export var offscreen_lod_bias = 1
+# Turning the view this many degrees since the last scan rescans as if the player changed cell
+@export var rescan_angle = 30.0
+# Also request the chunks around where the player will be once the current backlog is built
+@export var prefetch_rings = 4
+@export var prefetch_max_seconds = 2.0
+# Chebyshev ring (in chunks) where each LOD ends, anything further uses the coarsest one
+@export var lod_distances = [2, 4, 6]
+# Depth of the border skirts hiding cracks between chunks at different LODs
+@export var lod_skirt_depth = 16.0
+# Extra rings a chunk may drift outside the view square before it is unloaded
+@export var unload_margin = 2
+# Soft cap on resident chunk data, least recently seen chunks outside the view go first
+@export var memory_budget_mb = 256.0
+# Unloaded chunks kept hidden in the tree for reuse instead of being freed
+@export var chunk_pool_size = 64
+# Chebyshev ring (in chunks) around the player that gets heightmap collision
+@export var collision_radius = 1
+# Main thread time per frame for activating finished jobs, at least one always goes through
+@export var integration_budget_ms = 2.0
+# Keep chunks as RenderingServer instances and PhysicsServer3D bodies (ServerChunk) instead of nodes
+@export var server_mode = false
+# Keep sampled height grids under user://chunk_cache, only pays off with randomize_seed off
+@export var use_disk_cache = false
+# Sample height grids in compute shader batches, without a RenderingDevice the CPU does it as before
+@export var gpu_heightmaps = false
+@export var gpu_batch_size = 32
+# Serve height grids to other instances with the same seed and terrain (ChunkService), 0 = off
+@export var chunk_service_port = 0
+# Fetch height grids from a chunk service instead of sampling them, local generation whenever it is unreachable
+@export var chunk_server_address = ""
+@export var chunk_server_port = 24550
+# Seconds a requested grid may take before its chunk is generated here after all
+@export var remote_timeout = 3.0
+@export var remote_in_flight = 64
+# Draw every chunk from one shared grid mesh per LOD, displaced in the vertex shader from a height texture layer
+@export var displaced_mode = false
+# Chunks as Surface Nets over a 3D density field (VoxelChunk) with overhangs and caves, takes precedence over server_mode and displaced_mode; always LOD 0
+@export var voxel_mode = false
+# Largest height error (world units) of RTIN simplified chunk meshes, doubled per LOD; 0 = regular grids
+@export var adaptive_error = 0.0
+# 16 bit positions, UVs and octahedral normals for chunk meshes, a third less VRAM and upload but recycled chunks rebuild their surface
+@export var compress_chunk_meshes = false
+# Clipmap rings drawn around the view square out towards the far plane, 0 = none
+@export var far_field_levels = 0
+# Bake the far field rings into plain meshes on a pool thread instead of displacing them in a vertex shader
+@export var far_field_baked = false
+# Time every chunk pipeline stage into a ChunkProfiler, shown in the debugger's Monitors tab
+@export var profile_chunks = false
+@export var profiler_overlay = false
+# Written on exit when profiling, .json for JSON, anything else CSV
+@export var profile_dump_path = ""
+
+@onready var player = $CameraController
 
 var noise
+var heightmap_cache
+var displaced_terrain
+var adaptive_builder
+var voxel_field
+var far_field
+var profiler
+# Push time of each queued request, only kept while profiling
+var request_usec = {}
 var chunks = {}
-var unready_chunks = {}
-var thread
+var request_queue = ChunkRequestQueue.new()
+# GridSources in order of preference, cells go request_queue -> a source ->
+# sampled_queue -> chunk_jobs. Empty, chunk jobs sample request_queue cells themselves.
+var grid_sources = []
+var chunk_service
+var sampled_queue = ChunkRequestQueue.new()
+var chunk_jobs = {}
+var cancelled_chunks = {}
+var lod_requests = {}
+var lod_jobs = {}
+var collision_jobs = {}
+# Serial of the LOD and collision job running for each key, so a completion
+# still queued for integration can tell it was superseded
+var lod_serials = {}
+var collision_serials = {}
+var next_job_serial = 0
+var free_jobs = []
+# Pool threads hand finished work over here, _process activates it within the budget
+var finished_mutex = Mutex.new()
+var finished_jobs = []
+var integration_queue = []
+var integration_stats = {"queued": 0, "integrated": 0, "msec": 0.0, "max_msec": 0.0}
+var chunk_pool = []
+var resident_bytes = 0
+# Player cell of the last full rescan, null forces the next one
+var scanned_cell = null
+var scanned_heading = Vector2.ZERO
+# View cells inside the camera frustum as of the last scan, null without a camera
+var frustum_visible = null
+# Motion and throughput behind the prefetch, see update_motion()
+var last_player_position = null
+var player_velocity = Vector3.ZERO
+var built_chunks = 0
+var throughput = 0.0
+var lookahead = 0.0
+var prefetch_cell = null
+var scanned_prefetch = null
+var holes = 0
+var needs_clean_up = true
+var startup_usec = 0
+var startup_msec = -1
+var prewarm_task = -1
+var prewarm_cells = []
+var prewarm_center = Vector2i.ZERO
 
 func _ready():
-	randomize()
-	#noise = OpenSimplexNoise.new()
-	noise = FastNoiseLite.new()
-	noise.seed = randi()
-	noise.octaves = 6
-	noise.period = 80
+	startup_usec = Time.get_ticks_usec()
+	if randomize_seed:
+		randomize()
+		world_seed = randi()
+
+	noise = make_noise(world_seed)
+	if noise_graph != null:
+		# The exported graph stays a template, the copy holds the seeded sources and region caches
+		noise = noise_graph.duplicate()
+		noise.prepare(world_seed)
+	heightmap_cache = HeightmapCache.new(noise, chunk_size, Chunk.grid_resolution(chunk_size), Chunk.height_scale)
+	if use_disk_cache:
+		heightmap_cache.disk_cache = ChunkDiskCache.new(noise, chunk_size, Chunk.grid_resolution(chunk_size), Chunk.height_scale)
+
+	var params_hash = ChunkDiskCache.params_hash(noise, chunk_size, Chunk.grid_resolution(chunk_size), Chunk.height_scale)
+	if chunk_service_port > 0:
+		# Its own cache, grids for remote players must not pile up in ours
+		var service_cache = HeightmapCache.new(noise, chunk_size, Chunk.grid_resolution(chunk_size), Chunk.height_scale)
+		service_cache.disk_cache = heightmap_cache.disk_cache
+		chunk_service = ChunkService.new(service_cache, params_hash, chunk_service_port)
+		if not chunk_service.is_listening():
+			chunk_service = null
+	if chunk_server_address != "":
+		var client = ChunkServiceClient.new(chunk_server_address, chunk_server_port, params_hash, heightmap_cache.grid_width())
+		grid_sources.append(RemoteGridSource.new(client, remote_in_flight, remote_timeout))
+	if gpu_heightmaps:
+		var sampler = GpuHeightmapSampler.new(heightmap_cache, gpu_batch_size)
+		if sampler.is_available():
+			grid_sources.append(GpuGridSource.new(sampler))
+
+	# Every LOD halves the grid, past one cell per chunk its step no longer divides resolution - 1
+	var max_lod = 0
+	while (Chunk.grid_resolution(chunk_size) - 1) % (2 << max_lod) == 0:
+		max_lod += 1
+	if lod_distances.size() > max_lod:
+		push_warning("lod_distances has %d rings, chunks only have %d LODs below full detail" % [lod_distances.size(), max_lod])
+		lod_distances = lod_distances.slice(0, max_lod)
+
+	if adaptive_error > 0.0:
+		adaptive_builder = AdaptiveMeshBuilder.new(Chunk.grid_resolution(chunk_size), chunk_size, adaptive_error)
+
+	if voxel_mode:
+		voxel_field = VoxelField.new(world_seed)
+
+	if displaced_mode and not voxel_mode:
+		# One layer for every chunk that can be resident or pooled at once
+		var keep = chunk_amount / 2 + unload_margin
+		var layers = (keep * 2 + 1) * (keep * 2 + 1) + chunk_pool_size + prefetch_rings * prefetch_rings * 4
+		if layers > DisplacedTerrain.max_layers():
+			# Running out of layers would leave chunks without heights, regular meshes instead
+			push_warning("displaced_mode needs %d texture array layers, the device has %d; using regular meshes" % [layers, DisplacedTerrain.max_layers()])
+		else:
+			displaced_terrain = DisplacedTerrain.new(chunk_size, lod_distances.size() + 1, lod_skirt_depth, layers)
+
+	if far_field_levels > 0:
+		far_field = ClipmapTerrain.new()
+		far_field.levels = far_field_levels
+		# Level 0 at half a chunk per cell leaves a hole exactly the size of the view square
+		far_field.ring_cells = chunk_amount * 4
+		far_field.base_spacing = chunk_size * 0.5
+		far_field.baked = far_field_baked
+		far_field.noise = noise
+		far_field.height_scale = Chunk.height_scale
+		add_child(far_field)
+
+	if profile_chunks:
+		profiler = ChunkProfiler.new()
+		heightmap_cache.profiler = profiler
+		for source in grid_sources:
+			if source is GpuGridSource:
+				source.profiler = profiler
+		profiler.add_monitors()
+		if profiler_overlay:
+			var overlay = ChunkProfilerOverlay.new()
+			overlay.profiler = profiler
+			overlay.world = self
+			add_child(overlay)
+
+	if max_chunk_jobs <= 0:
+		max_chunk_jobs = max(1, OS.get_processor_count() - 1)
+
+	if prewarm_rings > 0:
+		start_prewarm()
+
+# The terrain noise for a seed, also used by the benchmark
+static func make_noise(noise_seed):
+	#terrain_noise = OpenSimplexNoise.new()
+	var terrain_noise = FastNoiseLite.new()
+	terrain_noise.seed = noise_seed
+	terrain_noise.fractal_octaves = 6
+	terrain_noise.frequency = 1.0 / 80
+	return terrain_noise
+
+func _exit_tree():
+	if prewarm_task >= 0:
+		WorkerThreadPool.wait_for_group_task_completion(prewarm_task)
+		prewarm_task = -1
+	for key in chunk_jobs:
+		WorkerThreadPool.wait_for_task_completion(chunk_jobs[key])
+	for key in lod_jobs:
+		WorkerThreadPool.wait_for_task_completion(lod_jobs[key])
+	for key in collision_jobs:
+		WorkerThreadPool.wait_for_task_completion(collision_jobs[key])
+	for task in free_jobs:
+		WorkerThreadPool.wait_for_task_completion(task)
+	chunk_jobs.clear()
+	lod_jobs.clear()
+	collision_jobs.clear()
+	lod_serials.clear()
+	collision_serials.clear()
+	free_jobs.clear()
+
+	# Server chunks are not children, so their RIDs have to be handed back by hand
+	for chunk in chunks.values() + chunk_pool:
+		if chunk is ServerChunk:
+			chunk.release()
+
+	for source in grid_sources:
+		source.close()
+	grid_sources.clear()
+	if chunk_service != null:
+		chunk_service.close()
+		chunk_service = null
 
-	thread = Thread.new()
+	if profiler != null:
+		profiler.remove_monitors()
+		if profile_dump_path != "":
+			profiler.save(profile_dump_path)
 
-func add_chunk(x,z):
-	var key = str(x) + "," + str(z)
-	if chunks.has(key) or unready_chunks.has(key):
+func add_chunk(x, z, priority):
+	var key = Vector2i(x, z)
+	if chunks.has(key):
+		return
+
+	if chunk_jobs.has(key):
+		cancelled_chunks.erase(key)
+		return
+
+	var source = source_of(key)
+	if source != null:
+		source.reprioritise(key, priority)
+		return
+	if sampled_queue.has(key):
+		sampled_queue.push(key, priority)
 		return
 
-	if not thread.is_active():
-		thread.start(self, "load_chunk", [thread, x, z])
-		unready_chunks[key] = 1
+	if profiler != null and not request_queue.has(key):
+		request_usec[key] = Time.get_ticks_usec()
+	request_queue.push(key, priority)
+
+func dispatch_chunk_jobs():
+	var queue = request_queue
+	# Also drains what a source that went away left in sampled_queue
+	if dispatch_grid_sources() or not sampled_queue.is_empty():
+		queue = sampled_queue
+
+	while chunk_jobs.size() < max_chunk_jobs and not queue.is_empty():
+		var key = queue.pop()
+		profile_queue_wait(key)
+		var lod = lod_for_cell(key, get_player_cell())
+		var job
+		if chunk_pool.is_empty():
+			job = load_chunk.bind(key, lod)
+		else:
+			job = recycle_chunk.bind(key, chunk_pool.pop_back(), lod)
+		chunk_jobs[key] = WorkerThreadPool.add_task(job, false, "chunk")
+
+	# LOD switches only get what new chunks left over
+	for key in lod_requests.keys():
+		if chunk_jobs.size() + lod_jobs.size() >= max_chunk_jobs:
+			break
+		var lod = lod_requests[key]
+		lod_requests.erase(key)
+		var serial = take_job_serial(lod_serials, key)
+		lod_jobs[key] = WorkerThreadPool.add_task(build_lod.bind(key, chunks[key], lod, serial), false, "chunk lod")
+
+# Hands what every source finished to the cache and the chunks on to the
+# pool, then gives the first ready source the front of the request queue.
+# False with no ready source, the caller then generates locally.
+func dispatch_grid_sources():
+	if grid_sources.is_empty():
+		return false
+	var player_cell = get_player_cell()
+	var heading = get_view_heading()
+	for source in grid_sources.duplicate():
+		var result = source.collect()
+		for cell in result.grids:
+			if is_wanted(cell, player_cell):
+				heightmap_cache.insert(cell, result.grids[cell])
+				sampled_queue.push(cell, chunk_priority(cell, player_cell, heading))
+		for cell in result.returned:
+			if is_wanted(cell, player_cell):
+				sampled_queue.push(cell, chunk_priority(cell, player_cell, heading))
+		if source.is_failed():
+			grid_sources.erase(source)
+			source.close()
+
+	for source in grid_sources:
+		if not source.is_ready():
+			continue
+		var capacity = source.capacity()
+		while capacity > 0 and not request_queue.is_empty():
+			var cell = request_queue.pop()
+			profile_queue_wait(cell)
+			var priority = chunk_priority(cell, player_cell, heading)
+			if heightmap_cache.get_grid(cell) != null:
+				sampled_queue.push(cell, priority)
+				continue
+			source.submit(cell, priority)
+			capacity -= 1
+		source.flush()
+		return true
+	return false
+
+func source_of(cell):
+	for source in grid_sources:
+		if source.has(cell):
+			return source
+	return null
+
+func grid_source_cells():
+	var count = 0
+	for source in grid_sources:
+		count += source.size()
+	return count
+
+func profile_queue_wait(key):
+	if profiler != null and request_usec.has(key):
+		profiler.since("queue", request_usec[key])
+		request_usec.erase(key)
+
+# Runs on a pool thread, the chunk is not in the tree yet so it can build its own children
+func load_chunk(key, lod):
+	var start = Time.get_ticks_usec()
+	var chunk
+	if voxel_mode:
+		chunk = VoxelChunk.new(noise, key.x*chunk_size, key.y*chunk_size, chunk_size, heightmap_cache)
+		chunk.position = Vector3(key.x*chunk_size, 0, key.y*chunk_size)
+		chunk.field = voxel_field
+	elif server_mode:
+		chunk = ServerChunk.new(noise, key.x*chunk_size, key.y*chunk_size, chunk_size, heightmap_cache)
+	else:
+		chunk = Chunk.new(noise, key.x*chunk_size, key.y*chunk_size, chunk_size, heightmap_cache)
+		chunk.position = Vector3(key.x*chunk_size, 0, key.y*chunk_size)
+	chunk.data.displaced = displaced_terrain
+	chunk.data.adaptive = adaptive_builder
+	chunk.data.compress = compress_chunk_meshes
+	chunk.data.profiler = profiler
+	chunk.generate_chunk(lod, lod_skirt_depth)
 
-func load_chunk(arr):
-	var thread = arr[0]
-	var x = arr[1]
-	var z = arr[2]
+	if profiler != null:
+		profiler.since("job", start)
+	finish_job(load_done.bind(key, chunk, false))
 
-	var chunk = Chunk.new(noise, x*chunk_size, z*chunk_size, chunk_size)
-	chunk.translation = Vector3(x*chunk_size, 0, z*chunk_size)
+# Runs on a pool thread, the pooled chunk is in the tree so only its data is rebuilt here
+func recycle_chunk(key, chunk, lod):
+	var start = Time.get_ticks_usec()
+	chunk.prepare_recycle(key.x*chunk_size, key.y*chunk_size, lod, lod_skirt_depth)
 
-	call_deferred("load_done", chunk, thread)
+	if profiler != null:
+		profiler.since("job", start)
+	finish_job(load_done.bind(key, chunk, true))
 
-func load_done(chunk, thread):
-	add_child(chunk)
-	var key = str(chunk.x / chunk_size) + "," + str(chunk.z/ chunk_size)
+func finish_job(integrate):
+	finished_mutex.lock()
+	finished_jobs.append(integrate)
+	finished_mutex.unlock()
+
+func integrate_finished_jobs(budget_ms = integration_budget_ms):
+	finished_mutex.lock()
+	integration_queue.append_array(finished_jobs)
+	finished_jobs.clear()
+	finished_mutex.unlock()
+
+	var start = Time.get_ticks_usec()
+	var budget = budget_ms * 1000.0
+	var done = 0
+	while done < integration_queue.size():
+		var job_start = Time.get_ticks_usec()
+		integration_queue[done].call()
+		if profiler != null:
+			profiler.since("integrate", job_start)
+		done += 1
+		if Time.get_ticks_usec() - start >= budget:
+			break
+
+	if done > 0:
+		integration_queue = integration_queue.slice(done)
+
+	var msec = (Time.get_ticks_usec() - start) / 1000.0
+	integration_stats.queued = integration_queue.size()
+	integration_stats.integrated = done
+	integration_stats.msec = msec
+	integration_stats.max_msec = max(integration_stats.max_msec, msec)
+
+# Backlog, jobs activated and time spent in the last frame, plus the worst frame so far
+func get_integration_stats():
+	return integration_stats
+
+func load_done(key, chunk, recycled):
+	if chunk_jobs.has(key):
+		WorkerThreadPool.wait_for_task_completion(chunk_jobs[key])
+		chunk_jobs.erase(key)
+
+	# Left the view radius while it was being built
+	if cancelled_chunks.erase(key):
+		heightmap_cache.erase(key)
+		chunk.data.recycled = {}
+		release_chunk(chunk)
+		return
+
+	if recycled:
+		chunk.apply_recycle()
+	else:
+		attach_chunk(chunk)
+	if displaced_terrain != null:
+		displaced_terrain.upload(chunk)
 	chunks[key] = chunk
-	unready_chunks.erase(key)
-	thread.wait_to_finish()
+	update_shown(key, chunk, get_player_cell())
+	built_chunks += 1
+	chunk.data.last_used = Time.get_ticks_msec()
+	resident_bytes += chunk.get_memory_bytes()
+	if resident_bytes > memory_budget_mb * 1048576.0:
+		needs_clean_up = true
+	request_lod(key, chunk)
+	update_collision(key, chunk, get_player_cell())
+
+func take_job_serial(serials, key):
+	next_job_serial += 1
+	serials[key] = next_job_serial
+	return next_job_serial
+
+func build_lod(key, chunk, lod, serial):
+	var built = chunk.build_lod_mesh(lod, lod_skirt_depth)
+	finish_job(lod_done.bind(key, chunk, lod, built, serial))
+
+func lod_done(key, chunk, lod, built, serial):
+	# Superseded, the newer job for the key cleans up after itself
+	if lod_serials.get(key) != serial:
+		return
+
+	WorkerThreadPool.wait_for_task_completion(lod_jobs[key])
+	lod_jobs.erase(key)
+	lod_serials.erase(key)
+	if chunks.get(key) != chunk:
+		return
+
+	resident_bytes -= chunk.get_memory_bytes()
+	chunk.set_lod_mesh(lod, built)
+	resident_bytes += chunk.get_memory_bytes()
+	request_lod(key, chunk)
+
+# Adds or drops collision as the chunk enters or leaves the collision ring,
+# with one ring of slack before it is dropped again
+func update_collision(key, chunk, player_cell):
+	var distance = max(abs(key.x - player_cell.x), abs(key.y - player_cell.y))
+	if distance <= collision_radius:
+		if not chunk.has_collision() and not collision_jobs.has(key):
+			var serial = take_job_serial(collision_serials, key)
+			collision_jobs[key] = WorkerThreadPool.add_task(build_collision.bind(key, chunk.collision_data(), serial), false, "chunk collision")
+	elif distance > collision_radius + 1 and chunk.has_collision():
+		resident_bytes -= chunk.data.collision_bytes
+		chunk.clear_collision()
+
+# Runs on a pool thread from the height grid (or voxel mesh arrays) alone, the chunk may be gone by the time it lands
+func build_collision(key, data, serial):
+	var start = Time.get_ticks_usec()
+	var shape
+	if voxel_mode:
+		shape = VoxelChunk.build_mesh_collision_shape(data)
+	else:
+		shape = Chunk.build_collision_shape(data, chunk_size)
+	if profiler != null:
+		profiler.since("collision", start)
+	finish_job(collision_done.bind(key, shape, serial))
+
+func collision_done(key, shape, serial):
+	if collision_serials.get(key) != serial:
+		return
+
+	WorkerThreadPool.wait_for_task_completion(collision_jobs[key])
+	collision_jobs.erase(key)
+	collision_serials.erase(key)
+
+	var chunk = chunks.get(key)
+	if chunk == null or chunk.has_collision():
+		return
+
+	resident_bytes -= chunk.data.collision_bytes
+	chunk.set_collision_shape(shape)
+	resident_bytes += chunk.data.collision_bytes
+
+# The scan only runs on cell changes, so chunks finishing in between check their own LOD
+func request_lod(key, chunk):
+	var lod = resident_lod(key, chunk, get_player_cell())
+	if lod != chunk.data.lod:
+		lod_requests[key] = lod
 
 func get_chunk(x, z):
-	var key = str(x) + "," + str(z)
-	if chunks.has(key):
-		return chunks.get(key)
+	return chunks.get(Vector2i(x, z))
 
-	return null
+func get_resident_chunk_count():
+	return chunks.size()
+
+func get_resident_bytes():
+	return resident_bytes
+
+# Requests waiting or being built, chunks activated per second while there
+# was a backlog, how far ahead (seconds) the prefetch looks, and cells
+# next to the player that were still empty when the player got there
+func get_streaming_stats():
+	return {
+		"queue_depth": request_queue.size() + grid_source_cells() + sampled_queue.size() + chunk_jobs.size(),
+		"throughput": throughput,
+		"lookahead": lookahead,
+		"prefetch_cell": prefetch_cell,
+		"holes": holes,
+	}
 
 func _process(delta):
+	if chunk_service != null:
+		chunk_service.poll()
+	if prewarm_task >= 0:
+		update_prewarm()
+		return
+
+	update_motion(delta)
 	update_chunks()
+	dispatch_chunk_jobs()
+	integrate_finished_jobs()
 	clean_up_chunks()
-	reset_chunks()
+
+	if startup_msec < 0 and scanned_cell != null and request_queue.is_empty() \
+			and grid_source_cells() == 0 and sampled_queue.is_empty() \
+			and chunk_jobs.is_empty() and integration_queue.is_empty():
+		finish_startup()
+
+func get_startup_msec():
+	return startup_msec
+
+func finish_startup():
+	startup_msec = (Time.get_ticks_usec() - startup_usec) / 1000.0
+	startup_finished.emit(startup_msec)
+
+# The world stays hidden and the streamer idle until every pre-warm chunk is in
+func start_prewarm():
+	prewarm_center = get_player_cell()
+	for x in range(prewarm_center.x - prewarm_rings + 1, prewarm_center.x + prewarm_rings):
+		for z in range(prewarm_center.y - prewarm_rings + 1, prewarm_center.y + prewarm_rings):
+			var cell = Vector2i(x, z)
+			if in_view(cell, prewarm_center):
+				prewarm_cells.append(cell)
+	# Group elements are handed out roughly in order, so go centre first
+	prewarm_cells.sort_custom(func(a, b): return (a - prewarm_center).length_squared() < (b - prewarm_center).length_squared())
+
+	visible = false
+	prewarm_task = WorkerThreadPool.add_group_task(prewarm_chunk, prewarm_cells.size(), -1, true, "chunk prewarm")
+
+# Runs on a pool thread for one pre-warm cell
+func prewarm_chunk(index):
+	var key = prewarm_cells[index]
+	load_chunk(key, lod_for_cell(key, prewarm_center))
+
+func update_prewarm():
+	prewarm_progress.emit(WorkerThreadPool.get_group_processed_element_count(prewarm_task), prewarm_cells.size())
+	if not WorkerThreadPool.is_group_task_completed(prewarm_task):
+		return
+
+	WorkerThreadPool.wait_for_group_task_completion(prewarm_task)
+	prewarm_task = -1
+	prewarm_cells.clear()
+
+	# Nothing is on screen yet, so there is no frame to protect
+	integrate_finished_jobs(INF)
+	visible = true
+	finish_startup()
+
+# Predicts the cell the player reaches by the time the backlog is built,
+# from the measured velocity and the build throughput
+func update_motion(delta):
+	var player_position = player.global_position
+	if "velocity" in player:
+		# The controller knows its own velocity, no need to guess it from positions
+		player_velocity = player.velocity
+	elif delta > 0.0 and last_player_position != null:
+		# Physics ticks and frames do not line up, so smooth over a few frames
+		player_velocity = player_velocity.lerp((player_position - last_player_position) / delta, 1.0 - exp(-delta / 0.25))
+	last_player_position = player_position
+
+	var backlog = get_streaming_stats().queue_depth
+	if backlog > 0 and delta > 0.0:
+		throughput = lerpf(throughput, built_chunks / delta, 1.0 - exp(-delta))
+	built_chunks = 0
+
+	prefetch_cell = null
+	if prefetch_rings <= 0 or player_velocity.length() < chunk_size * 0.5:
+		lookahead = 0.0
+		return
+	lookahead = prefetch_max_seconds if throughput <= 0.0 else min(backlog / throughput, prefetch_max_seconds)
+	var ahead = player_position + player_velocity * lookahead
+	var cell = Vector2i(floori(ahead.x / chunk_size), floori(ahead.z / chunk_size))
+	if cell != get_player_cell():
+		prefetch_cell = cell
+
+func get_player_cell():
+	var player_position = player.global_position # update to retrive submarine prosition
+	return Vector2i(floori(player_position.x / chunk_size), floori(player_position.z / chunk_size))
+
+# Flat forward direction of the player's view, or of the active camera
+# for players without get_heading(), zero when there is neither
+func get_view_heading():
+	if player.has_method("get_heading"):
+		return player.get_heading()
+
+	var camera = get_viewport().get_camera_3d()
+	if camera == null:
+		return Vector2.ZERO
+
+	var forward = -camera.global_transform.basis.z
+	return Vector2(forward.x, forward.z).normalized()
+
+# Distance stretched by up to heading_weight for cells behind the view,
+# plus offscreen_penalty outside the frustum. The player's own cell is 0.
+func chunk_priority(cell, player_cell, heading):
+	var offset = Vector2(cell - player_cell)
+	var distance = offset.length()
+	if distance == 0.0:
+		return 0.0
+
+	var priority = distance
+	if heading != Vector2.ZERO:
+		var facing = offset.dot(heading) / distance
+		priority *= 1.0 + heading_weight * (1.0 - facing) * 0.5
+	if frustum_visible != null and not frustum_visible.has(cell):
+		priority += offscreen_penalty
+	return priority
+
+# LOD from the distance rings alone
+func ring_lod(cell, player_cell):
+	var distance = max(abs(cell.x - player_cell.x), abs(cell.y - player_cell.y))
+	for lod in range(lod_distances.size()):
+		if distance < lod_distances[lod]:
+			return lod
+	return lod_distances.size()
+
+func lod_for_cell(cell, player_cell):
+	# Voxel chunks have no skirts, neighbours at different LODs would leave cracks
+	if voxel_mode:
+		return 0
+	var lod = ring_lod(cell, player_cell)
+	# Off screen chunks outside the innermost ring can wait for their detail until the camera turns
+	if lod > 0 and frustum_visible != null and not frustum_visible.has(cell):
+		lod = min(lod + offscreen_lod_bias, lod_distances.size())
+	return lod
+
+# View cells whose chunk box touches the camera frustum. Blocks of
+# cull_block x cull_block cells are tested first, so a block wholly in or
+# out costs a single test; null when there is no camera.
+func frustum_cells(player_cell):
+	var camera = get_viewport().get_camera_3d()
+	if camera == null:
+		return null
+
+	var planes = camera.get_frustum()
+	var half = chunk_amount / 2
+	var height = Chunk.height_scale + lod_skirt_depth
+	var chunk_extents = Vector3(chunk_size * 0.5, height, chunk_size * 0.5)
+	var block_extents = Vector3(cull_block * chunk_size * 0.5, height, cull_block * chunk_size * 0.5)
+	var cells = {}
+	for bx in range(player_cell.x - half, player_cell.x + half, cull_block):
+		for bz in range(player_cell.y - half, player_cell.y + half, cull_block):
+			# Chunk meshes are centred on cell * chunk_size
+			var block_center = Vector3(bx + (cull_block - 1) * 0.5, 0, bz + (cull_block - 1) * 0.5) * chunk_size
+			var block = box_in_frustum(block_center, block_extents, planes)
+			if block == OUTSIDE:
+				continue
+			for x in range(bx, min(bx + cull_block, player_cell.x + half)):
+				for z in range(bz, min(bz + cull_block, player_cell.y + half)):
+					if block == INSIDE or box_in_frustum(Vector3(x, 0, z) * chunk_size, chunk_extents, planes) != OUTSIDE:
+						cells[Vector2i(x, z)] = 1
+	return cells
+
+# Camera3D.get_frustum() planes face outwards
+static func box_in_frustum(center, extents, planes):
+	var result = INSIDE
+	for plane in planes:
+		var radius = extents.x * abs(plane.normal.x) + extents.y * abs(plane.normal.y) + extents.z * abs(plane.normal.z)
+		var distance = plane.distance_to(center)
+		if distance > radius:
+			return OUTSIDE
+		if distance > -radius:
+			result = CROSSING
+	return result
+
+# Turning away does not throw out detail a resident chunk already has
+func resident_lod(key, chunk, player_cell):
+	var lod = lod_for_cell(key, player_cell)
+	if lod > chunk.data.lod and ring_lod(key, player_cell) <= chunk.data.lod:
+		return chunk.data.lod
+	return lod
+
+func in_view(cell, player_cell):
+	var half = chunk_amount / 2
+	return cell.x >= player_cell.x - half and cell.x < player_cell.x + half \
+		and cell.y >= player_cell.y - half and cell.y < player_cell.y + half
+
+func in_prefetch(cell):
+	return prefetch_cell != null and max(abs(cell.x - prefetch_cell.x), abs(cell.y - prefetch_cell.y)) < prefetch_rings
+
+# In the view square or the prefetch square ahead of it
+func is_wanted(cell, player_cell):
+	return in_view(cell, player_cell) or in_prefetch(cell)
+
+func count_holes(player_cell):
+	for x in range(player_cell.x - 1, player_cell.x + 2):
+		for z in range(player_cell.y - 1, player_cell.y + 2):
+			if not chunks.has(Vector2i(x, z)):
+				holes += 1
 
 func update_chunks():
-	var player_translateion = $Player.translation # update to retrive submarine prosition
-	var p_x = int(player_translateion.x) / chunk_size
-	var p_z = int(player_translateion.z) / chunk_size
+	# Nothing changes in the window until the player crosses into another cell or turns
+	var player_cell = get_player_cell()
+	var heading = get_view_heading()
+	var turned = heading != Vector2.ZERO and heading.dot(scanned_heading) < cos(deg_to_rad(rescan_angle))
+	if player_cell == scanned_cell and prefetch_cell == scanned_prefetch and not turned:
+		return
+
+	var half = chunk_amount / 2
+	var entered = []
+	var evicted = []
+	if player_cell != scanned_cell:
+		var low = player_cell - Vector2i(half, half)
+		if scanned_cell == null:
+			entered = square_cells(low, chunk_amount)
+		else:
+			count_holes(player_cell)
+			var old_low = scanned_cell - Vector2i(half, half)
+			entered = square_strips(old_low, low, chunk_amount)
+			evicted = square_strips(low, old_low, chunk_amount)
+		if far_field != null:
+			# Middle of the view square, which spans half a chunk more on the negative side
+			far_field.set_center(Vector2(player_cell) * chunk_size - Vector2(chunk_size, chunk_size) * 0.5)
+
+	# A step of more than a few cells touches about as much as a full scan anyway
+	if scanned_cell == null or turned or max(abs(player_cell.x - scanned_cell.x), abs(player_cell.y - scanned_cell.y)) > half / 2:
+		rescan_chunks(player_cell, heading)
+		scanned_heading = heading
+	else:
+		shift_chunks(player_cell, heading, entered, evicted)
+	scanned_cell = player_cell
+	scanned_prefetch = prefetch_cell
+
+	if not entered.is_empty():
+		strip_entered.emit(entered)
+	if not evicted.is_empty():
+		strip_evicted.emit(evicted)
+
+# Full pass over the view and every resident chunk
+func rescan_chunks(player_cell, heading):
+	frustum_visible = frustum_cells(player_cell)
+	needs_clean_up = true
+	var half = chunk_amount / 2
 
-	for x in range(p_x - chunk_amount * 0.5, p_x + chunk_amount * 0.5):
-		for z in range(p_z - chunk_amount * 0.5, p_z + chunk_amount * 0.5):
-			add_chunk(x, z)
+	for cell in request_queue.cells():
+		if not is_wanted(cell, player_cell):
+			request_queue.cancel(cell)
+			request_usec.erase(cell)
+
+	for cell in sampled_queue.cells():
+		if not is_wanted(cell, player_cell):
+			sampled_queue.cancel(cell)
+			heightmap_cache.erase(cell)
+
+	for source in grid_sources:
+		for cell in source.cells():
+			if not is_wanted(cell, player_cell):
+				source.cancel(cell)
+
+	for key in chunk_jobs:
+		if not is_wanted(key, player_cell):
+			cancelled_chunks[key] = 1
+
+	for x in range(player_cell.x - half, player_cell.x + half):
+		for z in range(player_cell.y - half, player_cell.y + half):
+			var cell = Vector2i(x, z)
+			add_chunk(x, z, chunk_priority(cell, player_cell, heading))
+
+	if prefetch_cell != null:
+		for x in range(prefetch_cell.x - prefetch_rings + 1, prefetch_cell.x + prefetch_rings):
+			for z in range(prefetch_cell.y - prefetch_rings + 1, prefetch_cell.y + prefetch_rings):
+				var cell = Vector2i(x, z)
+				add_chunk(x, z, chunk_priority(cell, player_cell, heading))
+
+	var now = Time.get_ticks_msec()
+	for key in chunks:
+		var chunk = chunks[key]
+		if is_wanted(key, player_cell):
+			chunk.data.last_used = now
+		update_shown(key, chunk, player_cell)
+		refresh_chunk(key, chunk, player_cell)
+
+# O(chunk_amount) update for a step of a few cells: only the strips that
+# moved in or out of the view, prefetch and keep squares are queued or
+# dropped, and only resident chunks on the LOD and collision ring
+# boundaries are looked at again. Queued requests keep their priority and
+# cells that stayed in view their frustum result until the next full scan.
+func shift_chunks(player_cell, heading, entered, evicted):
+	var camera = get_viewport().get_camera_3d()
+	var planes = camera.get_frustum() if camera != null and frustum_visible != null else null
+	var extents = Vector3(chunk_size * 0.5, Chunk.height_scale + lod_skirt_depth, chunk_size * 0.5)
+	for cell in evicted:
+		if frustum_visible != null:
+			frustum_visible.erase(cell)
+		if chunks.has(cell):
+			update_shown(cell, chunks[cell], player_cell)
+	for cell in entered:
+		if chunks.has(cell):
+			update_shown(cell, chunks[cell], player_cell)
+		if planes != null and box_in_frustum(Vector3(cell.x, 0, cell.y) * chunk_size, extents, planes) != OUTSIDE:
+			frustum_visible[cell] = 1
+		add_chunk(cell.x, cell.y, chunk_priority(cell, player_cell, heading))
+
+	var prefetch = prefetch_strips(scanned_prefetch, prefetch_cell)
+	for cell in prefetch[0]:
+		add_chunk(cell.x, cell.y, chunk_priority(cell, player_cell, heading))
+
+	var keep = chunk_amount / 2 + unload_margin
+	var dropped = evicted + prefetch[1]
+	if player_cell != scanned_cell:
+		dropped += square_strips(player_cell - Vector2i(keep, keep), scanned_cell - Vector2i(keep, keep), keep * 2 + 1)
+	var now = Time.get_ticks_msec()
+	for cell in dropped:
+		if is_wanted(cell, player_cell):
+			continue
+		drop_request(cell)
+		var chunk = chunks.get(cell)
+		if chunk == null:
+			continue
+		# Wanted up to this move, so it is the freshest of the idle chunks
+		chunk.data.last_used = now
+		if max(abs(cell.x - player_cell.x), abs(cell.y - player_cell.y)) <= keep:
+			continue
+		if lod_jobs.has(cell):
+			# Its mesh is being rebuilt, the next clean up takes it
+			needs_clean_up = true
+		else:
+			unload_chunk(cell)
+
+	var step = max(abs(player_cell.x - scanned_cell.x), abs(player_cell.y - scanned_cell.y))
+	for distance in boundary_distances(step):
+		for cell in ring_cells(player_cell, distance):
+			var chunk = chunks.get(cell)
+			if chunk != null:
+				refresh_chunk(cell, chunk, player_cell)
+
+	if resident_bytes > memory_budget_mb * 1048576.0:
+		needs_clean_up = true
+
+# Resident chunks outside the view square lie under clipmap level 0, whose
+# hole is only the view square, so with a far field they are hidden
+func update_shown(key, chunk, player_cell):
+	if far_field != null:
+		chunk.set_shown(in_view(key, player_cell))
+
+func drop_request(cell):
+	if request_queue.cancel(cell):
+		request_usec.erase(cell)
+	if sampled_queue.cancel(cell):
+		heightmap_cache.erase(cell)
+	var source = source_of(cell)
+	if source != null:
+		source.cancel(cell)
+	if chunk_jobs.has(cell):
+		cancelled_chunks[cell] = 1
+
+func refresh_chunk(key, chunk, player_cell):
+	var lod = resident_lod(key, chunk, player_cell)
+	if lod == chunk.data.lod or lod_jobs.has(key):
+		lod_requests.erase(key)
+	else:
+		lod_requests[key] = lod
+	update_collision(key, chunk, player_cell)
+
+# Chebyshev distances from the player at which a step of step cells can
+# change a resident chunk's ring LOD or its collision
+func boundary_distances(step):
+	var distances = {}
+	for boundary in lod_distances:
+		for distance in range(boundary - step, boundary + step):
+			distances[distance] = 1
+	for distance in range(collision_radius - step + 1, collision_radius + step + 2):
+		distances[distance] = 1
+	return distances.keys().filter(func(distance): return distance >= 0)
+
+static func ring_cells(center, radius):
+	if radius == 0:
+		return [center]
+	var cells = []
+	for i in range(-radius, radius):
+		cells.append(center + Vector2i(i, -radius))
+		cells.append(center + Vector2i(radius, i))
+		cells.append(center + Vector2i(-i, radius))
+		cells.append(center + Vector2i(-radius, -i))
+	return cells
+
+static func square_cells(low, size):
+	var cells = []
+	for z in range(low.y, low.y + size):
+		for x in range(low.x, low.x + size):
+			cells.append(Vector2i(x, z))
+	return cells
+
+# Cells of the size x size square at new_low that the one at old_low does not cover
+static func square_strips(old_low, new_low, size):
+	var cells = []
+	for z in range(new_low.y, new_low.y + size):
+		if z < old_low.y or z >= old_low.y + size:
+			for x in range(new_low.x, new_low.x + size):
+				cells.append(Vector2i(x, z))
+			continue
+		for x in range(new_low.x, min(old_low.x, new_low.x + size)):
+			cells.append(Vector2i(x, z))
+		for x in range(max(old_low.x + size, new_low.x), new_low.x + size):
+			cells.append(Vector2i(x, z))
+	return cells
+
+# Entered and left cells of the prefetch square, either centre may be null
+func prefetch_strips(old_cell, new_cell):
+	var size = prefetch_rings * 2 - 1
+	var offset = Vector2i(prefetch_rings - 1, prefetch_rings - 1)
+	if old_cell == new_cell or size <= 0:
+		return [[], []]
+	if old_cell == null:
+		return [square_cells(new_cell - offset, size), []]
+	if new_cell == null:
+		return [[], square_cells(old_cell - offset, size)]
+	return [square_strips(old_cell - offset, new_cell - offset, size), square_strips(new_cell - offset, old_cell - offset, size)]
 
 func clean_up_chunks():
-	pass
+	var reaped = []
+	for task in free_jobs:
+		if WorkerThreadPool.is_task_completed(task):
+			WorkerThreadPool.wait_for_task_completion(task)
+			reaped.append(task)
+	for task in reaped:
+		free_jobs.erase(task)
+
+	if not needs_clean_up:
+		return
+	needs_clean_up = false
+
+	var player_cell = get_player_cell()
+	var keep = chunk_amount / 2 + unload_margin
+	var outside = []
+	var idle = []
+	for key in chunks:
+		# Its mesh is being rebuilt on a pool thread
+		if lod_jobs.has(key):
+			continue
+		if is_wanted(key, player_cell):
+			continue
+		if max(abs(key.x - player_cell.x), abs(key.y - player_cell.y)) > keep:
+			outside.append(key)
+		else:
+			idle.append(key)
+
+	for key in outside:
+		unload_chunk(key)
+
+	var budget = memory_budget_mb * 1048576.0
+	if resident_bytes > budget and not idle.is_empty():
+		idle.sort_custom(func(a, b): return chunks[a].data.last_used < chunks[b].data.last_used)
+		for key in idle:
+			if resident_bytes <= budget:
+				break
+			unload_chunk(key)
+
+func unload_chunk(key):
+	var chunk = chunks[key]
+	chunks.erase(key)
+	lod_requests.erase(key)
+	heightmap_cache.erase(key)
+	resident_bytes -= chunk.get_memory_bytes()
+
+	release_chunk(chunk)
+
+func attach_chunk(chunk):
+	if chunk is ServerChunk:
+		chunk.attach(get_world_3d())
+	elif chunk.get_parent() == null:
+		add_child(chunk)
+
+func release_chunk(chunk):
+	if chunk_pool.size() < chunk_pool_size:
+		attach_chunk(chunk)
+		chunk.park()
+		chunk_pool.append(chunk)
+		return
+
+	if displaced_terrain != null:
+		displaced_terrain.release_layer(chunk)
+
+	if chunk is ServerChunk:
+		chunk.release()
+		return
 
-func reset_chunks():
-	pass
+	# Out of the tree it is ours alone, so the node and its resources can go on a pool thread
+	if chunk.get_parent() != null:
+		remove_child(chunk)
+	free_jobs.append(WorkerThreadPool.add_task(chunk.free, false, "chunk free"))